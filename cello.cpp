@@ -28,9 +28,13 @@
 #endif
 
 #include "cello/cello_computed_value.cpp"
+#include "cello/cello_diff.cpp"
+#include "cello/cello_dispatcher.cpp"
+#include "cello/cello_hash.cpp"
 #include "cello/cello_ipc.cpp"
 #include "cello/cello_object.cpp"
 #include "cello/cello_path.cpp"
 #include "cello/cello_query.cpp"
+#include "cello/cello_shared_memory.cpp"
 #include "cello/cello_sync.cpp"
 #include "cello/cello_value.cpp"
\ No newline at end of file
@@ -36,10 +36,14 @@ END_JUCE_MODULE_DECLARATION
 */
 
 #include "cello/cello_computed_value.h"
+#include "cello/cello_diff.h"
+#include "cello/cello_dispatcher.h"
+#include "cello/cello_hash.h"
 #include "cello/cello_ipc.h"
 #include "cello/cello_object.h"
 #include "cello/cello_path.h"
 #include "cello/cello_query.h"
+#include "cello/cello_shared_memory.h"
 #include "cello/cello_sync.h"
 #include "cello/cello_update_source.h"
 #include "cello/cello_value.h"
\ No newline at end of file
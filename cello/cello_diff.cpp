@@ -0,0 +1,308 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include "cello_diff.h"
+
+namespace
+{
+/**
+ * @brief Records the changes made to a tree while it exists, in the form
+ * of a patch.
+ */
+class PatchRecorder : public juce::ValueTreeSynchroniser
+{
+public:
+    explicit PatchRecorder (const juce::ValueTree& tree)
+    : juce::ValueTreeSynchroniser (tree)
+    {
+    }
+
+    void stateChanged (const void* encodedChange, size_t encodedChangeSize) override
+    {
+        patch.writeCompressedInt (static_cast<int> (encodedChangeSize));
+        patch.write (encodedChange, encodedChangeSize);
+    }
+
+    juce::MemoryOutputStream patch;
+};
+
+/**
+ * @brief Children with a key are matched on their type and key value together.
+ */
+juce::String makeMatchKey (const juce::ValueTree& child, const juce::Identifier& key)
+{
+    return child.getType ().toString () + "\n" + child[key].toString ();
+}
+
+/**
+ * @brief Target children without a key, in order, for a single type.
+ */
+struct Candidates
+{
+    std::vector<int> indices;
+    size_t next { 0 };
+};
+
+/**
+ * @brief Find a longest strictly increasing subsequence.
+ *
+ * @param sequence
+ * @return std::vector<bool> true for each element of `sequence` that's part
+ * of that subsequence.
+ */
+std::vector<bool> findLongestIncreasingRun (const std::vector<int>& sequence)
+{
+    const auto count { static_cast<int> (sequence.size ()) };
+    // tails[n] is the index of the smallest value that ends an increasing run
+    // of length n + 1.
+    std::vector<int> tails;
+    std::vector<int> previous (sequence.size (), -1);
+    for (int i { 0 }; i < count; ++i)
+    {
+        const auto pos { std::lower_bound (tails.begin (), tails.end (), sequence[static_cast<size_t> (i)],
+                                           [&sequence] (int index, int value)
+                                           { return sequence[static_cast<size_t> (index)] < value; }) };
+        if (pos != tails.begin ())
+            previous[static_cast<size_t> (i)] = *(pos - 1);
+        if (pos == tails.end ())
+            tails.push_back (i);
+        else
+            *pos = i;
+    }
+
+    std::vector<bool> inRun (sequence.size (), false);
+    for (int i { tails.empty () ? -1 : tails.back () }; i >= 0; i = previous[static_cast<size_t> (i)])
+        inRun[static_cast<size_t> (i)] = true;
+    return inRun;
+}
+
+} // namespace
+
+namespace cello
+{
+
+Diff::Diff (const juce::Identifier& matchKey)
+: key { matchKey }
+{
+}
+
+juce::MemoryBlock Diff::apply (juce::ValueTree target, const juce::ValueTree& source, juce::UndoManager* undo)
+{
+    stats       = {};
+    undoManager = undo;
+
+    if (!target.isValid () || !source.isValid () || target == source)
+        return {};
+
+    // we can't change the type of a tree.
+    jassert (target.getType () == source.getType ());
+
+    PatchRecorder recorder { target };
+    diffTree (target, source);
+    return recorder.patch.getMemoryBlock ();
+}
+
+bool Diff::applyPatch (juce::ValueTree& target, const juce::MemoryBlock& patch, juce::UndoManager* undo)
+{
+    juce::MemoryInputStream input { patch, false };
+    while (!input.isExhausted ())
+    {
+        const auto size { input.readCompressedInt () };
+        if (size <= 0 || size > input.getNumBytesRemaining ())
+            return false;
+
+        const auto* change { static_cast<const char*> (patch.getData ()) + input.getPosition () };
+        if (!juce::ValueTreeSynchroniser::applyChange (target, change, static_cast<size_t> (size), undo))
+            return false;
+
+        input.skipNextBytes (size);
+    }
+    return true;
+}
+
+void Diff::diffTree (juce::ValueTree& target, const juce::ValueTree& source)
+{
+    diffProperties (target, source);
+    diffChildren (target, source);
+}
+
+void Diff::diffProperties (juce::ValueTree& target, const juce::ValueTree& source)
+{
+    // remove anything the source doesn't have...
+    for (int i { target.getNumProperties () - 1 }; i >= 0; --i)
+    {
+        const auto name { target.getPropertyName (i) };
+        if (!source.hasProperty (name))
+        {
+            target.removeProperty (name, undoManager);
+            ++stats.propertiesRemoved;
+        }
+    }
+
+    // ...and set anything that's new or different.
+    for (int i { 0 }; i < source.getNumProperties (); ++i)
+    {
+        const auto name { source.getPropertyName (i) };
+        const auto& value { source.getProperty (name) };
+        const auto* current { target.getPropertyPointer (name) };
+        if (current == nullptr || !current->equalsWithSameType (value))
+        {
+            target.setProperty (name, value, undoManager);
+            ++stats.propertiesSet;
+        }
+    }
+}
+
+void Diff::diffChildren (juce::ValueTree& target, const juce::ValueTree& source)
+{
+    const auto sourceCount { source.getNumChildren () };
+    const auto targetCount { target.getNumChildren () };
+    if (sourceCount == 0 && targetCount == 0)
+        return;
+
+    // index the target's children so we can match them up.
+    juce::HashMap<juce::String, int> keyedChildren;
+    std::unordered_map<const void*, Candidates> unkeyedChildren;
+    for (int i { 0 }; i < targetCount; ++i)
+    {
+        const auto child { target.getChild (i) };
+        if (isKeyed (child))
+        {
+            const auto matchKey { makeMatchKey (child, key) };
+            if (!keyedChildren.contains (matchKey))
+                keyedChildren.set (matchKey, i);
+        }
+        else
+            unkeyedChildren[child.getType ().getCharPointer ().getAddress ()].indices.push_back (i);
+    }
+
+    // the target child matched with each source child (invalid if none)
+    std::vector<juce::ValueTree> matches (static_cast<size_t> (sourceCount));
+    std::vector<int> matchedIndices (static_cast<size_t> (sourceCount), -1);
+    std::vector<bool> targetMatched (static_cast<size_t> (targetCount), false);
+    for (int i { 0 }; i < sourceCount; ++i)
+    {
+        const auto child { source.getChild (i) };
+        int index { -1 };
+        if (isKeyed (child))
+        {
+            const auto matchKey { makeMatchKey (child, key) };
+            if (keyedChildren.contains (matchKey))
+                index = keyedChildren[matchKey];
+        }
+        else
+        {
+            const auto found { unkeyedChildren.find (child.getType ().getCharPointer ().getAddress ()) };
+            if (found != unkeyedChildren.end () && found->second.next < found->second.indices.size ())
+                index = found->second.indices[found->second.next++];
+        }
+
+        if (index >= 0 && !targetMatched[static_cast<size_t> (index)])
+        {
+            targetMatched[static_cast<size_t> (index)] = true;
+            matches[static_cast<size_t> (i)]          = target.getChild (index);
+            matchedIndices[static_cast<size_t> (i)]   = index;
+        }
+    }
+
+    // remove the target children that have no match, noting how far each
+    // remaining child shifts as a result.
+    std::vector<int> removedBefore (static_cast<size_t> (targetCount), 0);
+    int removedCount { 0 };
+    for (int i { 0 }; i < targetCount; ++i)
+    {
+        removedBefore[static_cast<size_t> (i)] = removedCount;
+        if (!targetMatched[static_cast<size_t> (i)])
+            ++removedCount;
+    }
+    for (int i { targetCount - 1 }; i >= 0; --i)
+    {
+        if (!targetMatched[static_cast<size_t> (i)])
+        {
+            target.removeChild (i, undoManager);
+            ++stats.childrenRemoved;
+        }
+    }
+
+    // The matched children that are already in the right order relative to
+    // each other (the longest such run) stay where they are; every other
+    // matched child needs to move.
+    std::vector<int> sequence;
+    std::vector<int> sequencePos (static_cast<size_t> (sourceCount), -1);
+    for (int i { 0 }; i < sourceCount; ++i)
+    {
+        const auto index { matchedIndices[static_cast<size_t> (i)] };
+        if (index >= 0)
+        {
+            sequencePos[static_cast<size_t> (i)] = static_cast<int> (sequence.size ());
+            sequence.push_back (index - removedBefore[static_cast<size_t> (index)]);
+        }
+    }
+    const auto staysPut { findLongestIncreasingRun (sequence) };
+
+    // Working back from the end, place each child that moves (or is new)
+    // immediately before the child that follows it in the source.
+    juce::ValueTree following;
+    for (int i { sourceCount - 1 }; i >= 0; --i)
+    {
+        auto& match { matches[static_cast<size_t> (i)] };
+        if (match.isValid ())
+        {
+            if (!staysPut[static_cast<size_t> (sequencePos[static_cast<size_t> (i)])])
+            {
+                const auto from { target.indexOf (match) };
+                auto to { following.isValid () ? target.indexOf (following) : target.getNumChildren () };
+                if (from < to)
+                    --to;
+                if (from != to)
+                {
+                    target.moveChild (from, to, undoManager);
+                    ++stats.childrenMoved;
+                }
+            }
+            following = match;
+        }
+        else
+        {
+            auto child { source.getChild (i).createCopy () };
+            target.addChild (child, following.isValid () ? target.indexOf (following) : -1, undoManager);
+            ++stats.childrenAdded;
+            following = child;
+        }
+    }
+
+    // ...and finally, descend into the children that were matched.
+    for (int i { 0 }; i < sourceCount; ++i)
+    {
+        auto& match { matches[static_cast<size_t> (i)] };
+        if (match.isValid ())
+            diffTree (match, source.getChild (i));
+    }
+}
+
+bool Diff::isKeyed (const juce::ValueTree& child) const
+{
+    return key.isValid () && child.hasProperty (key);
+}
+
+} // namespace cello
+
+#if RUN_UNIT_TESTS
+#include "test/test_cello_diff.inl"
+#endif
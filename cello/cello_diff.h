@@ -0,0 +1,123 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <juce_data_structures/juce_data_structures.h>
+
+namespace cello
+{
+
+/**
+ * @class Diff
+ * @brief Make one tree equivalent to another by applying only the changes
+ * needed to get there, instead of tearing down and rebuilding its contents
+ * the way `ValueTree::copyPropertiesAndChildrenFrom()` does.
+ *
+ * Children of the two trees are matched up either by type and the value of a
+ * key property, or (for children without a key) by type and position among
+ * the children of that type. Then:
+ * - unmatched children of the target are removed
+ * - the fewest possible matched children are moved to get them in order
+ * - unmatched children of the source are copied in
+ * - matched children are compared recursively, and only properties whose
+ *   values differ are set (or removed).
+ *
+ * The changes made are recorded as a patch that can be applied to another
+ * copy of the target tree with `applyPatch()`. A patch is a sequence of
+ * `juce::ValueTreeSynchroniser` messages, each preceded by its size.
+ *
+ * Note that properties added to the target are appended, so the order of
+ * properties in the two trees may differ afterwards.
+ */
+class Diff
+{
+public:
+    /**
+     * @param key property used to match children of the two trees; pass a null
+     *            Identifier to match all children by type and position.
+     */
+    explicit Diff (const juce::Identifier& key = {});
+
+    /**
+     * @brief Change `target` so it's equivalent to `source`.
+     *
+     * @param target tree to change
+     * @param source tree to match. Must have the same type as `target`, and
+     *               must not be part of the target tree.
+     * @param undo undo manager used for every change.
+     * @return juce::MemoryBlock patch describing the changes that were made.
+     */
+    juce::MemoryBlock apply (juce::ValueTree target, const juce::ValueTree& source, juce::UndoManager* undo = nullptr);
+
+    /**
+     * @brief Apply a patch returned by `apply()` to another tree that was
+     * equivalent to that call's target.
+     *
+     * @param target
+     * @param patch
+     * @param undo
+     * @return false if any change in the patch couldn't be applied.
+     */
+    static bool applyPatch (juce::ValueTree& target, const juce::MemoryBlock& patch, juce::UndoManager* undo = nullptr);
+
+    /**
+     * @brief Counts of the changes made by the last call to `apply()`.
+     */
+    struct Stats
+    {
+        int propertiesSet { 0 };
+        int propertiesRemoved { 0 };
+        int childrenAdded { 0 };
+        int childrenRemoved { 0 };
+        int childrenMoved { 0 };
+
+        int getTotal () const
+        {
+            return propertiesSet + propertiesRemoved + childrenAdded + childrenRemoved + childrenMoved;
+        }
+    };
+
+    const Stats& getStats () const { return stats; }
+
+private:
+    /**
+     * @brief Bring one target tree in line with its matching source tree, and
+     * then recurse into their children.
+     */
+    void diffTree (juce::ValueTree& target, const juce::ValueTree& source);
+
+    void diffProperties (juce::ValueTree& target, const juce::ValueTree& source);
+
+    void diffChildren (juce::ValueTree& target, const juce::ValueTree& source);
+
+    /**
+     * @return true if children should be matched on our key for this child.
+     */
+    bool isKeyed (const juce::ValueTree& child) const;
+
+    const juce::Identifier key;
+
+    juce::UndoManager* undoManager { nullptr };
+
+    Stats stats;
+};
+
+} // namespace cello
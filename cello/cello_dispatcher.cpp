@@ -0,0 +1,194 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <algorithm>
+#include <array>
+
+#include "cello_dispatcher.h"
+#include "cello_hash.h"
+#include "cello_object.h"
+
+namespace
+{
+/**
+ * @brief All of the live Dispatchers, bucketed by the identity of the tree
+ * each one watches (see `cello::getTreeIdentity()`), so a bucket normally
+ * holds a single Dispatcher. (A Dispatcher keeps its tree alive, so the
+ * identity can't be reused while it's registered.) Within a bucket we compare
+ * trees directly, so if the identity isn't available, falling back to the
+ * tree's (interned) type is slower but still correct. The registry is split
+ * into shards with their own locks, so threads working with different trees
+ * rarely wait for each other.
+ */
+struct DispatcherRegistry
+{
+    struct Shard
+    {
+        juce::CriticalSection lock;
+        std::unordered_map<const void*, std::vector<cello::Dispatcher*>> buckets;
+    };
+
+    Shard& getShard (const void* key)
+    {
+        // (the low bits of an address are always the same.)
+        return shards[(reinterpret_cast<std::uintptr_t> (key) >> 4) % shards.size ()];
+    }
+
+    std::array<Shard, 16> shards;
+};
+
+DispatcherRegistry& getRegistry ()
+{
+    static DispatcherRegistry registry;
+    return registry;
+}
+
+const void* getBucketKey (const juce::ValueTree& tree)
+{
+    if (const auto* identity { cello::getTreeIdentity (tree) })
+        return identity;
+    return tree.getType ().getCharPointer ().getAddress ();
+}
+
+} // namespace
+
+namespace cello
+{
+
+Dispatcher::Dispatcher (const juce::ValueTree& treeToWatch)
+: tree { treeToWatch }
+{
+    tree.addListener (this);
+}
+
+Dispatcher::~Dispatcher ()
+{
+    tree.removeListener (this);
+
+    const auto key { getBucketKey (tree) };
+    auto& shard { getRegistry ().getShard (key) };
+    const juce::ScopedLock lock { shard.lock };
+    const auto found { shard.buckets.find (key) };
+    if (found != shard.buckets.end ())
+    {
+        auto& bucket { found->second };
+        bucket.erase (std::remove (bucket.begin (), bucket.end (), this), bucket.end ());
+        if (bucket.empty ())
+            shard.buckets.erase (found);
+    }
+}
+
+Dispatcher::Ptr Dispatcher::attach (Object& object)
+{
+    const auto& tree { object.data };
+    if (!tree.isValid ())
+        return nullptr;
+
+    Ptr dispatcher;
+    {
+        const auto key { getBucketKey (tree) };
+        auto& shard { getRegistry ().getShard (key) };
+        const juce::ScopedLock lock { shard.lock };
+        auto& bucket { shard.buckets[key] };
+        for (auto* candidate : bucket)
+        {
+            if (candidate->tree == tree)
+            {
+                dispatcher = candidate;
+                break;
+            }
+        }
+
+        if (dispatcher == nullptr)
+        {
+            dispatcher = new Dispatcher (tree);
+            bucket.push_back (dispatcher.get ());
+        }
+    }
+
+    if (object.subtreeListener)
+        dispatcher->subtreeObjects.add (&object);
+    else
+    {
+        dispatcher->objects.add (&object);
+        if (object.keyIndex != nullptr)
+            dispatcher->childWatchers.add (&object);
+    }
+
+    return dispatcher;
+}
+
+void Dispatcher::detach (Object& object)
+{
+    objects.remove (&object);
+    childWatchers.remove (&object);
+    subtreeObjects.remove (&object);
+}
+
+template <typename Fn> void Dispatcher::notify (bool exactTree, bool childProperty, Fn&& fn)
+{
+    // an Object may detach (and so release us) from inside a callback.
+    const Ptr keepAlive { this };
+
+    auto callObject = [&fn] (Object& object)
+    {
+        if (excluded == nullptr || excluded != &object)
+            fn (object);
+    };
+
+    if (exactTree)
+        objects.call (callObject);
+    else if (childProperty)
+        childWatchers.call (callObject);
+
+    subtreeObjects.call (callObject);
+}
+
+void Dispatcher::valueTreePropertyChanged (juce::ValueTree& treeWhosePropertyHasChanged, const juce::Identifier& property)
+{
+    const auto exactTree { treeWhosePropertyHasChanged == tree };
+    const auto childProperty { !exactTree && !childWatchers.isEmpty () && treeWhosePropertyHasChanged.getParent () == tree };
+    notify (exactTree, childProperty,
+            [&] (Object& object) { object.valueTreePropertyChanged (treeWhosePropertyHasChanged, property); });
+}
+
+void Dispatcher::valueTreeChildAdded (juce::ValueTree& parentTree, juce::ValueTree& childTree)
+{
+    notify (parentTree == tree, false, [&] (Object& object) { object.valueTreeChildAdded (parentTree, childTree); });
+}
+
+void Dispatcher::valueTreeChildRemoved (juce::ValueTree& parentTree, juce::ValueTree& childTree, int index)
+{
+    notify (parentTree == tree, false,
+            [&] (Object& object) { object.valueTreeChildRemoved (parentTree, childTree, index); });
+}
+
+void Dispatcher::valueTreeChildOrderChanged (juce::ValueTree& parentTree, int oldIndex, int newIndex)
+{
+    notify (parentTree == tree, false,
+            [&] (Object& object) { object.valueTreeChildOrderChanged (parentTree, oldIndex, newIndex); });
+}
+
+void Dispatcher::valueTreeParentChanged (juce::ValueTree& treeWhoseParentHasChanged)
+{
+    notify (treeWhoseParentHasChanged == tree, false,
+            [&] (Object& object) { object.valueTreeParentChanged (treeWhoseParentHasChanged); });
+}
+
+} // namespace cello
@@ -0,0 +1,144 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <juce_core/juce_core.h>
+#include <juce_data_structures/juce_data_structures.h>
+
+namespace cello
+{
+class Object;
+
+/**
+ * @class Dispatcher
+ * @brief Routes ValueTree callbacks to the cello::Objects that are bound to a
+ * tree.
+ *
+ * JUCE delivers every change to the listeners on the tree that changed *and* on
+ * all of its ancestors, so if each Object registered itself as a listener, every
+ * Object wrapping the same tree or one of its ancestors would receive (and then
+ * discard) every change. Instead, exactly one Dispatcher is registered as a
+ * listener for each tree that has Objects bound to it, and it passes each event
+ * on only to the Objects that are interested in it, so the cost of an event
+ * doesn't depend on how many Objects exist elsewhere in the hierarchy.
+ *
+ * Objects attach/detach themselves; you shouldn't need to use this class
+ * directly, except for `ScopedExclusion`.
+ *
+ * As with ValueTrees themselves, a tree and the Objects bound to it should only
+ * be used from a single thread at a time; the registry used to find the
+ * Dispatcher for a tree is safe to use from multiple threads. Finding a tree's
+ * Dispatcher takes constant time, however many other trees have Objects bound
+ * to them (unless `getTreeIdentity()` isn't available with this version of
+ * JUCE, in which case it's proportional to the number of trees of the same
+ * type that have Objects bound to them.)
+ */
+class Dispatcher : public juce::ValueTree::Listener,
+                   public juce::ReferenceCountedObject
+{
+public:
+    using Ptr = juce::ReferenceCountedObjectPtr<Dispatcher>;
+
+    ~Dispatcher () override;
+
+    /**
+     * @brief Find (or create) the Dispatcher for the tree that an Object wraps,
+     * and start routing events to that Object.
+     *
+     * @param object
+     * @return Ptr the Dispatcher (nullptr if the object's tree is invalid). The
+     * Object must keep this alive until it calls `detach()`.
+     */
+    static Ptr attach (Object& object);
+
+    /**
+     * @brief Stop routing events to an Object. Safe to call from inside one of
+     * that Object's callbacks.
+     *
+     * @param object
+     */
+    void detach (Object& object);
+
+    /**
+     * @class ScopedExclusion
+     * @brief While one of these exists, the listener passed to it will not be
+     * sent callbacks by any Dispatcher on this thread. This is how a
+     * `setPropertyExcludingListener()` call is extended to Objects, which
+     * aren't registered with the tree directly.
+     */
+    class ScopedExclusion
+    {
+    public:
+        explicit ScopedExclusion (const juce::ValueTree::Listener* listener)
+        : previous { excluded }
+        {
+            excluded = listener;
+        }
+
+        ~ScopedExclusion () { excluded = previous; }
+
+        ScopedExclusion (const ScopedExclusion&)            = delete;
+        ScopedExclusion& operator= (const ScopedExclusion&) = delete;
+
+    private:
+        const juce::ValueTree::Listener* previous;
+    };
+
+    void valueTreePropertyChanged (juce::ValueTree& treeWhosePropertyHasChanged,
+                                   const juce::Identifier& property) override;
+    void valueTreeChildAdded (juce::ValueTree& parentTree, juce::ValueTree& childTree) override;
+    void valueTreeChildRemoved (juce::ValueTree& parentTree, juce::ValueTree& childTree, int index) override;
+    void valueTreeChildOrderChanged (juce::ValueTree& parentTree, int oldIndex, int newIndex) override;
+    void valueTreeParentChanged (juce::ValueTree& tree) override;
+
+private:
+    explicit Dispatcher (const juce::ValueTree& treeToWatch);
+
+    /**
+     * @brief Call a function on each Object that should receive an event,
+     * skipping the currently excluded listener.
+     *
+     * @param exactTree true if the event happened on our tree, as opposed to
+     * one of its descendants.
+     * @param childProperty true if this is a property change of one of our
+     * direct children.
+     * @param fn
+     */
+    template <typename Fn> void notify (bool exactTree, bool childProperty, Fn&& fn);
+
+    /// the tree we're listening to. This handle is never reassigned.
+    juce::ValueTree tree;
+
+    /// Objects that receive events that happen on our tree itself.
+    juce::ListenerList<Object> objects;
+
+    /// Objects that also want property changes of our direct children (to
+    /// keep a key index up to date).
+    juce::ListenerList<Object> childWatchers;
+
+    /// Objects that asked to receive every event from our tree and all its
+    /// descendants.
+    juce::ListenerList<Object> subtreeObjects;
+
+    /// listener to skip on this thread, see `ScopedExclusion`.
+    static inline thread_local const juce::ValueTree::Listener* excluded { nullptr };
+};
+
+} // namespace cello
@@ -0,0 +1,491 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <cstring>
+#include <type_traits>
+
+#include "cello_hash.h"
+#include "cello_sync.h"
+
+namespace
+{
+// 64-bit FNV-1a
+constexpr juce::uint64 fnvOffset { 14695981039346656037ull };
+constexpr juce::uint64 fnvPrime { 1099511628211ull };
+
+juce::uint64 hashBytes (juce::uint64 hash, const void* data, size_t size)
+{
+    const auto* bytes { static_cast<const juce::uint8*> (data) };
+    for (size_t i { 0 }; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= fnvPrime;
+    }
+    return hash;
+}
+
+juce::uint64 combine (juce::uint64 hash, juce::uint64 value)
+{
+    return hashBytes (hash, &value, sizeof (value));
+}
+
+juce::uint64 hashString (juce::uint64 hash, const juce::String& text)
+{
+    return hashBytes (hash, text.toRawUTF8 (), text.getNumBytesAsUTF8 ());
+}
+
+/**
+ * @brief Hash of a tree's type and properties, combined so that the order of
+ * the properties doesn't matter.
+ */
+juce::uint64 hashTreeContents (const juce::ValueTree& tree)
+{
+    juce::uint64 properties { 0 };
+    for (int i { 0 }; i < tree.getNumProperties (); ++i)
+    {
+        const auto name { tree.getPropertyName (i) };
+        properties += combine (hashString (fnvOffset, name.toString ()), cello::ContentHash::calculate (tree[name]));
+    }
+    return combine (hashString (fnvOffset, tree.getType ().toString ()), properties);
+}
+
+/**
+ * @brief The first pointer-sized member of a ValueTree, which (in the JUCE
+ * versions we know of) points to the data that's shared by every handle to
+ * the same tree.
+ */
+const void* readFirstPointer (const juce::ValueTree& tree)
+{
+    static_assert (!std::is_polymorphic_v<juce::ValueTree>);
+    static_assert (sizeof (juce::ValueTree) >= sizeof (const void*));
+    const void* pointer;
+    std::memcpy (&pointer, &tree, sizeof (pointer));
+    return pointer;
+}
+
+/**
+ * @return true if a ValueTree's first pointer behaves like the identity of
+ * its shared data: the same for every handle to a tree, different for another
+ * tree, and null for an invalid tree.
+ */
+bool firstPointerIsIdentity ()
+{
+    const juce::ValueTree original { "cello" };
+    const juce::ValueTree copy { original };
+    const juce::ValueTree other { "cello" };
+    const auto* identity { readFirstPointer (original) };
+    return identity != nullptr && identity == readFirstPointer (copy) && identity != readFirstPointer (other) &&
+           readFirstPointer (juce::ValueTree {}) == nullptr;
+}
+
+/**
+ * @brief Start a ValueTreeSynchroniser message that applies to the root tree.
+ */
+void writeRootHeader (juce::MemoryOutputStream& output, cello::SyncChangeType type)
+{
+    output.writeByte (static_cast<char> (type));
+    // length of the path from the root.
+    output.writeCompressedInt (0);
+}
+
+} // namespace
+
+namespace cello
+{
+
+const void* getTreeIdentity (const juce::ValueTree& tree)
+{
+    static const bool identityAvailable { firstPointerIsIdentity () };
+    return identityAvailable ? readFirstPointer (tree) : nullptr;
+}
+
+ContentHash::ContentHash (const juce::ValueTree& tree)
+{
+    setTree (tree);
+}
+
+ContentHash::~ContentHash ()
+{
+    root.removeListener (this);
+}
+
+void ContentHash::setTree (const juce::ValueTree& tree)
+{
+    root.removeListener (this);
+    root     = tree;
+    rootNode = makeNode (root, nullptr);
+    nodes.clear ();
+    track (*rootNode);
+    root.addListener (this);
+}
+
+juce::uint64 ContentHash::get () const
+{
+    return refresh (*rootNode);
+}
+
+juce::uint64 ContentHash::get (const juce::ValueTree& subtree) const
+{
+    if (auto* node { findNode (subtree) })
+        return refresh (*node);
+    return calculate (subtree);
+}
+
+juce::uint64 ContentHash::calculate (const juce::ValueTree& tree)
+{
+    auto node { makeNode (tree, nullptr) };
+    return refresh (*node);
+}
+
+juce::uint64 ContentHash::calculate (const juce::var& value)
+{
+    // start from a different place for each type of value.
+    if (value.isVoid () || value.isUndefined ())
+        return combine (fnvOffset, value.isVoid () ? 0 : 1);
+    if (value.isBool ())
+        return combine (combine (fnvOffset, 2), static_cast<bool> (value) ? 1 : 0);
+    if (value.isInt ())
+        return combine (combine (fnvOffset, 3), static_cast<juce::uint64> (static_cast<int> (value)));
+    if (value.isInt64 ())
+        return combine (combine (fnvOffset, 4), static_cast<juce::uint64> (static_cast<juce::int64> (value)));
+    if (value.isDouble ())
+    {
+        const auto number { static_cast<double> (value) };
+        return hashBytes (combine (fnvOffset, 5), &number, sizeof (number));
+    }
+    if (value.isString ())
+        return hashString (combine (fnvOffset, 6), value.toString ());
+    if (value.isBinaryData ())
+    {
+        const auto* block { value.getBinaryData () };
+        return hashBytes (combine (fnvOffset, 7), block->getData (), block->getSize ());
+    }
+    if (value.isArray ())
+    {
+        auto hash { combine (fnvOffset, 8) };
+        for (const auto& element : *value.getArray ())
+            hash = combine (hash, calculate (element));
+        return hash;
+    }
+    if (value.isObject ())
+        return hashString (combine (fnvOffset, 9), juce::JSON::toString (value, true));
+
+    // methods can't be compared.
+    return combine (fnvOffset, 10);
+}
+
+juce::uint64 ContentHash::calculateProperties (const juce::ValueTree& tree)
+{
+    return hashTreeContents (tree);
+}
+
+std::unique_ptr<ContentHash::Node> ContentHash::makeNode (const juce::ValueTree& tree, Node* parent)
+{
+    auto node { std::make_unique<Node> () };
+    node->tree   = tree;
+    node->parent = parent;
+    node->children.reserve (static_cast<size_t> (tree.getNumChildren ()));
+    for (const auto& child : tree)
+        node->children.push_back (makeNode (child, node.get ()));
+    return node;
+}
+
+void ContentHash::track (Node& node)
+{
+    const auto* identity { getTreeIdentity (node.tree) };
+    if (identity == nullptr)
+        return;
+    nodes[identity] = &node;
+    for (auto& child : node.children)
+        track (*child);
+}
+
+void ContentHash::untrack (const Node& node)
+{
+    const auto* identity { getTreeIdentity (node.tree) };
+    if (identity == nullptr)
+        return;
+    const auto found { nodes.find (identity) };
+    if (found != nodes.end () && found->second == &node)
+        nodes.erase (found);
+    for (const auto& child : node.children)
+        untrack (*child);
+}
+
+void ContentHash::rebuildChildren (Node& node)
+{
+    for (const auto& child : node.children)
+        untrack (*child);
+    node.children.clear ();
+    for (const auto& child : node.tree)
+    {
+        node.children.push_back (makeNode (child, &node));
+        track (*node.children.back ());
+    }
+}
+
+juce::uint64 ContentHash::refresh (Node& node)
+{
+    if (!node.stale)
+        return node.hash;
+
+    auto hash { hashTreeContents (node.tree) };
+    hash = combine (hash, node.children.size ());
+    for (const auto& child : node.children)
+        hash = combine (hash, refresh (*child));
+
+    node.hash  = hash;
+    node.stale = false;
+    return hash;
+}
+
+ContentHash::Node* ContentHash::findNode (const juce::ValueTree& tree) const
+{
+    if (const auto* identity { getTreeIdentity (tree) })
+    {
+        const auto found { nodes.find (identity) };
+        if (found == nodes.end ())
+            return nullptr;
+        if (found->second->tree == tree)
+            return found->second;
+        // (this shouldn't be possible, but don't trust the index if it is.)
+        jassertfalse;
+    }
+    return searchForNode (tree);
+}
+
+ContentHash::Node* ContentHash::searchForNode (const juce::ValueTree& tree) const
+{
+    // find the indices that lead from our root to the tree...
+    juce::Array<int> path;
+    for (auto current { tree }; current != root;)
+    {
+        auto parent { current.getParent () };
+        if (!parent.isValid ())
+            return nullptr;
+        path.add (parent.indexOf (current));
+        current = parent;
+    }
+
+    // ...and follow them down from our root node.
+    auto* node { rootNode.get () };
+    for (int i { path.size () - 1 }; i >= 0; --i)
+    {
+        const auto index { static_cast<size_t> (path[i]) };
+        if (index >= node->children.size ())
+            return nullptr;
+        node = node->children[index].get ();
+    }
+    return node;
+}
+
+ContentHash::Node* ContentHash::invalidate (const juce::ValueTree& tree)
+{
+    auto* node { findNode (tree) };
+    for (auto* ancestor { node }; ancestor != nullptr && !ancestor->stale; ancestor = ancestor->parent)
+        ancestor->stale = true;
+    return node;
+}
+
+void ContentHash::valueTreePropertyChanged (juce::ValueTree& tree, const juce::Identifier&)
+{
+    invalidate (tree);
+}
+
+void ContentHash::valueTreeChildAdded (juce::ValueTree& parentTree, juce::ValueTree& childTree)
+{
+    if (auto* node { invalidate (parentTree) })
+    {
+        // if another listener changed this tree again before we were notified
+        // of this change, just rebuild this part of the cache.
+        if (node->children.size () + 1 != static_cast<size_t> (parentTree.getNumChildren ()))
+        {
+            rebuildChildren (*node);
+            return;
+        }
+        const auto index { parentTree.indexOf (childTree) };
+        const auto added { node->children.insert (node->children.begin () + index, makeNode (childTree, node)) };
+        track (**added);
+    }
+}
+
+void ContentHash::valueTreeChildRemoved (juce::ValueTree& parentTree, juce::ValueTree&, int index)
+{
+    if (auto* node { invalidate (parentTree) })
+    {
+        if (node->children.size () != static_cast<size_t> (parentTree.getNumChildren ()) + 1 ||
+            !juce::isPositiveAndBelow (index, static_cast<int> (node->children.size ())))
+        {
+            rebuildChildren (*node);
+            return;
+        }
+        untrack (*node->children[static_cast<size_t> (index)]);
+        node->children.erase (node->children.begin () + index);
+    }
+}
+
+void ContentHash::valueTreeChildOrderChanged (juce::ValueTree& parentTree, int oldIndex, int newIndex)
+{
+    if (auto* node { invalidate (parentTree) })
+    {
+        const auto count { static_cast<int> (node->children.size ()) };
+        if (juce::isPositiveAndBelow (oldIndex, count) && juce::isPositiveAndBelow (newIndex, count))
+        {
+            auto moved { std::move (node->children[static_cast<size_t> (oldIndex)]) };
+            node->children.erase (node->children.begin () + oldIndex);
+            node->children.insert (node->children.begin () + newIndex, std::move (moved));
+        }
+    }
+}
+
+//
+//////////////////////////////////////////////////////////////////////////
+//
+
+ContentManifest ContentManifest::create (const juce::ValueTree& tree, const ContentHash* cache)
+{
+    auto hashOf = [cache] (const juce::ValueTree& subtree)
+    { return cache != nullptr ? cache->get (subtree) : ContentHash::calculate (subtree); };
+
+    ContentManifest manifest;
+    manifest.treeHash       = hashOf (tree);
+    manifest.propertiesHash = ContentHash::calculateProperties (tree);
+    for (int i { 0 }; i < tree.getNumProperties (); ++i)
+        manifest.propertyNames.add (tree.getPropertyName (i));
+    for (const auto& child : tree)
+        manifest.childHashes.add (hashOf (child));
+    return manifest;
+}
+
+void ContentManifest::writeToStream (juce::OutputStream& output) const
+{
+    output.writeInt64 (static_cast<juce::int64> (treeHash));
+    output.writeInt64 (static_cast<juce::int64> (propertiesHash));
+    output.writeCompressedInt (propertyNames.size ());
+    for (const auto& name : propertyNames)
+        output.writeString (name.toString ());
+    output.writeCompressedInt (childHashes.size ());
+    for (const auto hash : childHashes)
+        output.writeInt64 (static_cast<juce::int64> (hash));
+}
+
+bool ContentManifest::readFromStream (juce::InputStream& input, ContentManifest& manifest)
+{
+    manifest                = {};
+    manifest.treeHash       = static_cast<juce::uint64> (input.readInt64 ());
+    manifest.propertiesHash = static_cast<juce::uint64> (input.readInt64 ());
+
+    const auto propertyCount { input.readCompressedInt () };
+    if (propertyCount < 0)
+        return false;
+    for (int i { 0 }; i < propertyCount && !input.isExhausted (); ++i)
+    {
+        const auto name { input.readString () };
+        if (name.isEmpty ())
+            return false;
+        manifest.propertyNames.add (name);
+    }
+
+    const auto childCount { input.readCompressedInt () };
+    if (childCount < 0 || manifest.propertyNames.size () != propertyCount)
+        return false;
+    for (int i { 0 }; i < childCount; ++i)
+    {
+        if (input.getNumBytesRemaining () < static_cast<juce::int64> (sizeof (juce::int64)))
+            return false;
+        manifest.childHashes.add (static_cast<juce::uint64> (input.readInt64 ()));
+    }
+    return true;
+}
+
+std::vector<juce::MemoryBlock> ContentManifest::createUpdates (const juce::ValueTree& tree,
+                                                                const ContentHash* cache) const
+{
+    auto hashOf = [cache] (const juce::ValueTree& subtree)
+    { return cache != nullptr ? cache->get (subtree) : ContentHash::calculate (subtree); };
+
+    std::vector<juce::MemoryBlock> updates;
+    if (hashOf (tree) == treeHash)
+        return updates;
+
+    if (ContentHash::calculateProperties (tree) != propertiesHash)
+    {
+        for (const auto& name : propertyNames)
+        {
+            if (!tree.hasProperty (name))
+            {
+                juce::MemoryOutputStream output;
+                writeRootHeader (output, SyncChangeType::propertyRemoved);
+                output.writeString (name.toString ());
+                updates.push_back (output.getMemoryBlock ());
+            }
+        }
+        for (int i { 0 }; i < tree.getNumProperties (); ++i)
+        {
+            const auto name { tree.getPropertyName (i) };
+            juce::MemoryOutputStream output;
+            writeRootHeader (output, SyncChangeType::propertyChanged);
+            output.writeString (name.toString ());
+            tree[name].writeToStream (output);
+            updates.push_back (output.getMemoryBlock ());
+        }
+    }
+
+    auto removeChild = [&updates] (int index)
+    {
+        juce::MemoryOutputStream output;
+        writeRootHeader (output, SyncChangeType::childRemoved);
+        output.writeCompressedInt (index);
+        updates.push_back (output.getMemoryBlock ());
+    };
+
+    auto addChild = [&updates, &tree] (int index)
+    {
+        juce::MemoryOutputStream output;
+        writeRootHeader (output, SyncChangeType::childAdded);
+        output.writeCompressedInt (index);
+        tree.getChild (index).writeToStream (output);
+        updates.push_back (output.getMemoryBlock ());
+    };
+
+    const auto localCount { tree.getNumChildren () };
+    const auto remoteCount { childHashes.size () };
+    // replace the children that differ...
+    for (int i { 0 }; i < juce::jmin (localCount, remoteCount); ++i)
+    {
+        if (hashOf (tree.getChild (i)) != childHashes[i])
+        {
+            removeChild (i);
+            addChild (i);
+        }
+    }
+    // ...and remove or add any at the end.
+    for (int i { remoteCount - 1 }; i >= localCount; --i)
+        removeChild (i);
+    for (int i { remoteCount }; i < localCount; ++i)
+        addChild (i);
+
+    return updates;
+}
+
+} // namespace cello
+
+#if RUN_UNIT_TESTS
+#include "test/test_cello_hash.inl"
+#endif
@@ -0,0 +1,251 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <unordered_map>
+
+#include <juce_core/juce_core.h>
+#include <juce_data_structures/juce_data_structures.h>
+
+namespace cello
+{
+
+/**
+ * @brief Get the address of the data that's shared by every handle to the
+ * same tree (which is what `ValueTree::operator==` compares), to use as a key
+ * for that tree.
+ *
+ * JUCE doesn't expose it, but it's the first member of a ValueTree. Since
+ * that's a private detail that could change, the first time this is called it
+ * checks that the first member really does behave that way (the same for
+ * every handle to a tree and different for another tree); if it doesn't,
+ * this always returns nullptr, and callers have to find trees some other way.
+ * Callers should still compare the trees they find with `==`.
+ *
+ * The address may be reused once the tree is deleted, so whatever is keyed by
+ * it should keep the tree alive.
+ *
+ * @param tree
+ * @return const void* nullptr for an invalid tree, or if this version of
+ *         JUCE doesn't lay ValueTrees out the way we expect.
+ */
+const void* getTreeIdentity (const juce::ValueTree& tree);
+
+/**
+ * @class ContentHash
+ * @brief Maintains a Merkle-style hash of the contents of a ValueTree and each
+ * of its subtrees, so that two trees (or subtrees) can be compared without
+ * walking them.
+ *
+ * A tree's hash combines its type, its properties (in any order) and the
+ * hashes of its children (in order); two trees with the same hash are
+ * equivalent except for the order of their properties.
+ *
+ * The hashes are cached in a structure that mirrors the tree, indexed by the
+ * identity of each subtree (see `getTreeIdentity()`; where that isn't
+ * available, a subtree's cached hash is found by its index in each of its
+ * ancestors instead.) As the tree changes, only the hashes of the changed
+ * trees and their ancestors are marked as stale (without searching their
+ * siblings), and they're recalculated the next time they're requested.
+ *
+ * As with ValueTrees, a ContentHash should only be used from the thread that
+ * owns its tree.
+ */
+class ContentHash : private juce::ValueTree::Listener
+{
+public:
+    /**
+     * @param tree the tree to track
+     */
+    explicit ContentHash (const juce::ValueTree& tree);
+
+    ~ContentHash () override;
+
+    ContentHash (const ContentHash&)            = delete;
+    ContentHash& operator= (const ContentHash&) = delete;
+
+    /**
+     * @brief Start tracking a different tree.
+     *
+     * @param tree
+     */
+    void setTree (const juce::ValueTree& tree);
+
+    const juce::ValueTree& getTree () const { return root; }
+
+    /**
+     * @return juce::uint64 hash of the entire tree we're tracking.
+     */
+    juce::uint64 get () const;
+
+    /**
+     * @brief Get the hash of a subtree of the tree we're tracking.
+     *
+     * @param subtree
+     * @return juce::uint64 its hash, calculated without the cache if it isn't
+     * part of our tree.
+     */
+    juce::uint64 get (const juce::ValueTree& subtree) const;
+
+    /**
+     * @brief Calculate the hash of a tree from scratch.
+     *
+     * @param tree
+     * @return juce::uint64
+     */
+    static juce::uint64 calculate (const juce::ValueTree& tree);
+
+    /**
+     * @brief Calculate the hash of a single value; values of different types
+     * (e.g. `1` and `"1"`) have different hashes.
+     *
+     * @param value
+     * @return juce::uint64
+     */
+    static juce::uint64 calculate (const juce::var& value);
+
+    /**
+     * @brief Calculate a hash of only a tree's type and properties, ignoring
+     * its children.
+     *
+     * @param tree
+     * @return juce::uint64
+     */
+    static juce::uint64 calculateProperties (const juce::ValueTree& tree);
+
+private:
+    /**
+     * @brief cached hash for a tree; its children correspond to the children
+     * of that tree.
+     */
+    struct Node
+    {
+        /// (keeps the tree alive, so its identity can't be reused while
+        /// it's in our index.)
+        juce::ValueTree tree;
+        Node* parent { nullptr };
+        juce::uint64 hash { 0 };
+        bool stale { true };
+        std::vector<std::unique_ptr<Node>> children;
+    };
+
+    static std::unique_ptr<Node> makeNode (const juce::ValueTree& tree, Node* parent);
+
+    /**
+     * @brief Add a node and all of its descendants to our index, or remove
+     * them from it.
+     */
+    void track (Node& node);
+    void untrack (const Node& node);
+
+    /**
+     * @brief Start a node's children over from its tree's children.
+     */
+    void rebuildChildren (Node& node);
+
+    /**
+     * @brief Find the node for a tree, marking it and all of its ancestors as
+     * stale.
+     *
+     * @return Node* nullptr if that tree isn't part of ours.
+     */
+    Node* invalidate (const juce::ValueTree& tree);
+
+    /**
+     * @brief Find the node for a tree without changing anything.
+     */
+    Node* findNode (const juce::ValueTree& tree) const;
+
+    /**
+     * @brief Find the node for a tree by following its index in each of its
+     * ancestors; used when our index can't be (see `getTreeIdentity()`).
+     */
+    Node* searchForNode (const juce::ValueTree& tree) const;
+
+    static juce::uint64 refresh (Node& node);
+
+    void valueTreePropertyChanged (juce::ValueTree& tree, const juce::Identifier& property) override;
+    void valueTreeChildAdded (juce::ValueTree& parentTree, juce::ValueTree& childTree) override;
+    void valueTreeChildRemoved (juce::ValueTree& parentTree, juce::ValueTree& childTree, int index) override;
+    void valueTreeChildOrderChanged (juce::ValueTree& parentTree, int oldIndex, int newIndex) override;
+
+    /// the tree we're tracking.
+    juce::ValueTree root;
+
+    /// cached hashes; mutable so that stale hashes can be refreshed on demand.
+    mutable std::unique_ptr<Node> rootNode;
+
+    /// the node for each tree in ours, by the tree's identity (empty if
+    /// that isn't available.)
+    std::unordered_map<const void*, Node*> nodes;
+};
+
+/**
+ * @struct ContentManifest
+ * @brief A summary of a tree's contents: its hash, the names of its own
+ * properties and the hash of each of its children. Given the manifest of a
+ * remote copy of a tree, we can work out which parts of the local tree need
+ * to be sent to bring the remote copy up to date, instead of sending all of it.
+ */
+struct ContentManifest
+{
+    /// hash of the entire tree
+    juce::uint64 treeHash { 0 };
+    /// hash of the tree's type and properties
+    juce::uint64 propertiesHash { 0 };
+    juce::Array<juce::Identifier> propertyNames;
+    juce::Array<juce::uint64> childHashes;
+
+    /**
+     * @brief Summarize a tree.
+     *
+     * @param tree
+     * @param cache if not nullptr, a ContentHash that's tracking `tree`, used
+     *              to avoid recalculating hashes.
+     * @return ContentManifest
+     */
+    static ContentManifest create (const juce::ValueTree& tree, const ContentHash* cache = nullptr);
+
+    void writeToStream (juce::OutputStream& output) const;
+
+    /**
+     * @brief Read a manifest written by `writeToStream()`.
+     *
+     * @param input
+     * @param manifest
+     * @return false if the data was malformed.
+     */
+    static bool readFromStream (juce::InputStream& input, ContentManifest& manifest);
+
+    /**
+     * @brief Create the `juce::ValueTreeSynchroniser` messages that will
+     * change the tree this manifest describes to match `tree`. Root properties
+     * are only sent if they differ, and children are only replaced if their
+     * hashes differ.
+     *
+     * @param tree
+     * @param cache if not nullptr, a ContentHash that's tracking `tree`
+     * @return std::vector<juce::MemoryBlock> messages to apply, in order;
+     *         empty if the trees already match.
+     */
+    std::vector<juce::MemoryBlock> createUpdates (const juce::ValueTree& tree, const ContentHash* cache = nullptr) const;
+};
+
+} // namespace cello
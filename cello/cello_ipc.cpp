@@ -26,6 +26,112 @@ namespace
 // headers. At some point it's probably worth finding a good way
 // to parameterize this.
 juce::uint32 CelloMagicIpcNumber { 0x000C3110 };
+
+// Our own control messages share the connection with ValueTreeSynchroniser
+// messages, whose first byte is one of its (small) change type values.
+enum ControlMessage : juce::uint8
+{
+    firstControlMessage = 0x20,
+    /// [manifest] sent on connecting
+    contentManifest = firstControlMessage,
+    /// [manifest] sent after missing an update
+    resyncRequest,
+    /// [origin][sequence][ValueTreeSynchroniser message]
+    sequencedUpdate,
+    /// [origin][sequence][ValueTreeSynchroniser message] sent in reply to a manifest
+    resyncUpdate,
+    /// [origin][sequence] ends the reply to a manifest
+    resyncComplete,
+    /// [origin][sequence][count]([size][ValueTreeSynchroniser message]...)
+    batchedUpdate,
+    /// sent on connecting by an end that compresses its messages
+    compressionOffer,
+    /// [uncompressed size][zlib-compressed message]
+    compressedMessage
+};
+
+// [type][origin][sequence] at the start of each sequenced message.
+constexpr size_t sequencedHeaderSize { 13 };
+
+void writeSequencedHeader (juce::OutputStream& output, juce::uint8 messageType, juce::uint32 origin,
+                           juce::int64 sequence)
+{
+    output.writeByte (static_cast<char> (messageType));
+    output.writeInt (static_cast<int> (origin));
+    output.writeInt64 (sequence);
+}
+
+// a batch's header also has the number of changes in it.
+constexpr size_t batchHeaderSize { sequencedHeaderSize + 4 };
+
+/**
+ * Call `fn (data, size)` with each of the changes in a batched update.
+ * @return the number of changes in the batch.
+ */
+template <typename Fn> int forEachBatchedChange (const void* data, size_t size, Fn&& fn)
+{
+    juce::MemoryInputStream input { data, size, false };
+    input.skipNextBytes (static_cast<juce::int64> (sequencedHeaderSize));
+    const auto count { input.readInt () };
+    for (int i { 0 }; i < count; ++i)
+    {
+        const auto changeSize { input.readCompressedInt () };
+        const auto position { static_cast<size_t> (input.getPosition ()) };
+        if (changeSize < 0 || position + static_cast<size_t> (changeSize) > size)
+        {
+            // a damaged batch.
+            jassertfalse;
+            return i;
+        }
+        fn (static_cast<const char*> (data) + position, static_cast<size_t> (changeSize));
+        input.skipNextBytes (changeSize);
+    }
+    return count;
+}
+
+bool isBatch (const void* data, size_t size)
+{
+    return size >= batchHeaderSize && static_cast<const juce::uint8*> (data)[0] == ControlMessage::batchedUpdate;
+}
+
+/**
+ * @return `message`, compressed, or an empty block if compressing it doesn't
+ * make it any smaller.
+ */
+juce::MemoryBlock compressMessage (const juce::MemoryBlock& message)
+{
+    juce::MemoryOutputStream output { message.getSize () / 2 };
+    output.writeByte (static_cast<char> (ControlMessage::compressedMessage));
+    output.writeInt (static_cast<int> (message.getSize ()));
+    {
+        // the fastest level; we're trying to save time, not space.
+        juce::GZIPCompressorOutputStream zipper { output, 1 };
+        zipper.write (message.getData (), message.getSize ());
+    }
+    if (output.getDataSize () >= message.getSize ())
+        return {};
+    return output.getMemoryBlock ();
+}
+
+bool decompress (const juce::MemoryBlock& message, juce::MemoryBlock& inflated)
+{
+    juce::MemoryInputStream input { message, false };
+    input.skipNextBytes (1);
+    const auto size { input.readInt () };
+    if (size <= 0)
+        return false;
+
+    // the size comes from the peer, so rather than allocating it up front,
+    // inflate a piece at a time (reading one byte more than we were told to
+    // expect, to catch a message that's longer.)
+    juce::GZIPDecompressorInputStream unzipper { input };
+    juce::int64 inflatedSize { 0 };
+    {
+        juce::MemoryOutputStream output { inflated, false };
+        inflatedSize = output.writeFromInputStream (unzipper, static_cast<juce::int64> (size) + 1);
+    }
+    return inflatedSize == size;
+}
 } // namespace
 
 namespace juce
@@ -42,16 +148,20 @@ namespace cello
 {
 
 IpcClient::IpcClient (Object& objectToWatch, UpdateType updateType, const juce::String& hostName, int portNum,
-                      const juce::String& pipeName, int msTimeout, Object* state)
+                      const juce::String& pipeName, int msTimeout, Object* state, IpcServer* owner)
 : juce::InterprocessConnection { true, CelloMagicIpcNumber }
-, juce::ValueTreeSynchroniser { objectToWatch }
+// a server's connections leave watching the tree to the server.
+, juce::ValueTreeSynchroniser { owner == nullptr ? static_cast<juce::ValueTree> (objectToWatch) : juce::ValueTree {} }
 , UpdateQueue { objectToWatch, nullptr }
+, syncObject { objectToWatch }
 , clientProperties { objectToWatch.getType ().toString (), state }
 , update { updateType }
 , host { hostName }
 , port { portNum }
 , pipe { pipeName }
 , timeout { msTimeout }
+, server { owner }
+, originId { static_cast<juce::uint32> (juce::Random::getSystemRandom ().nextInt ()) }
 {
     // verify that the update type makes basic sense
     // need to either send or receive
@@ -75,8 +185,34 @@ IpcClient::IpcClient (Object& objectToWatch, const juce::String& pipeName, int m
     jassert (pipe.isNotEmpty ());
 }
 
+IpcClient::IpcClient (Object& objectToWatch, const SharedMemory& sharedMemory, int msTimeout, UpdateType updateType,
+                      Object* state)
+: IpcClient (objectToWatch, updateType, "", 0, "", msTimeout, state)
+{
+    jassert (sharedMemory.name.isNotEmpty ());
+    sharedMemoryChannel = std::make_unique<SharedMemoryChannel> (sharedMemory.name, sharedMemory.ringSize);
+    sharedMemoryChannel->onConnect    = [this] () { connectionMade (); };
+    sharedMemoryChannel->onDisconnect = [this] () { connectionLost (); };
+    sharedMemoryChannel->onMessage    = [this] (const juce::MemoryBlock& message) { messageReceived (message); };
+}
+
+class IpcClient::BatchTimer : public juce::Timer
+{
+public:
+    explicit BatchTimer (IpcClient& owner)
+    : client (owner)
+    {
+    }
+
+    void timerCallback () override { client.flush (); }
+
+private:
+    IpcClient& client;
+};
+
 IpcClient::~IpcClient ()
 {
+    flush ();
     disconnect ();
 }
 
@@ -89,6 +225,23 @@ bool IpcClient::connect (ConnectOptions options)
         return connectToSocket (host, port, timeout);
     }
 
+    if (sharedMemoryChannel != nullptr)
+    {
+        switch (options)
+        {
+            case ConnectOptions::createOrFail:
+                return sharedMemoryChannel->create (true);
+            case ConnectOptions::mustExist:
+                return sharedMemoryChannel->open (timeout);
+            case ConnectOptions::createIfNeeded:
+                return sharedMemoryChannel->create (false);
+            case ConnectOptions::noOptions:
+            default:
+                jassertfalse;
+                return false;
+        }
+    }
+
     if (pipe.isNotEmpty ())
     {
         // else -- create and/or connect to a named pipe;
@@ -111,47 +264,554 @@ bool IpcClient::connect (ConnectOptions options)
     return false;
 }
 
+bool IpcClient::isConnected () const
+{
+    if (sharedMemoryChannel != nullptr)
+        return sharedMemoryChannel->isConnected ();
+    return juce::InterprocessConnection::isConnected ();
+}
+
+void IpcClient::disconnect ()
+{
+    if (sharedMemoryChannel == nullptr)
+    {
+        juce::InterprocessConnection::disconnect ();
+        return;
+    }
+
+    // closing the channel stops its thread, so it can't tell us about this.
+    const bool wasConnected { sharedMemoryChannel->isAttached () && clientProperties.connected };
+    sharedMemoryChannel->close ();
+    if (wasConnected)
+        connectionLost ();
+}
+
 void IpcClient::connectionMade ()
 {
     clientProperties.connected = true;
-    if (update & UpdateType::fullUpdateOnConnect)
-        sendFullSyncCallback ();
+    // the other end has to know this before it replies to our manifest.
+    peerCompresses = false;
+    if (compression)
+        sendCompressionOffer ();
+    // the other end will tell us what it already has.
+    awaitingManifest = (update & UpdateType::fullUpdateOnConnect) != 0;
+    resyncPending    = false;
+    if (update & UpdateType::receive)
+        sendManifest (ControlMessage::contentManifest);
 }
 
 void IpcClient::connectionLost ()
 {
     clientProperties.connected = false;
+    awaitingManifest           = false;
+    peerCompresses             = false;
+    // the other end will bring itself back up to date when we reconnect,
+    // either from our replay log or from its manifest.
+    if (replayLog.getMaxBytes () > 0)
+        flush ();
+    else
+        discardBatch ();
+
+    // a client that reconnects to a server gets a new connection.
+    if (server != nullptr)
+    {
+        dropped = true;
+        server->connectionDropped ();
+    }
+}
+
+void IpcClient::setBatching (int maxBytes, int maxDelayMs)
+{
+    if (maxBytes <= 0)
+        flush ();
+    batchBytes = juce::jmax (0, maxBytes);
+    batchDelay = juce::jmax (1, maxDelayMs);
+    if (batchBytes > 0 && batchTimer == nullptr)
+        batchTimer = std::make_unique<BatchTimer> (*this);
+}
+
+void IpcClient::flush ()
+{
+    if (batchTimer != nullptr)
+        batchTimer->stopTimer ();
+    if (batchCount == 0)
+        return;
+
+    auto message { batch.getMemoryBlock () };
+    juce::MemoryOutputStream header { message.getData (), batchHeaderSize };
+    writeSequencedHeader (header, ControlMessage::batchedUpdate, originId, nextSequence++);
+    header.writeInt (batchCount);
+    if (sendSequenced (nextSequence - 1, message))
+        clientProperties.txCount += batchCount;
+    discardBatch ();
+}
+
+void IpcClient::setReplayLog (size_t maxBytes)
+{
+    replayLog.setMaxBytes (maxBytes);
+}
+
+const ReplayLog& IpcClient::getReplayLog () const
+{
+    return server != nullptr ? server->replayLog : replayLog;
+}
+
+juce::uint32 IpcClient::getSendingOrigin () const
+{
+    return server != nullptr ? server->originId : originId;
+}
+
+juce::int64 IpcClient::getLastSentSequence () const
+{
+    return (server != nullptr ? server->nextSequence : nextSequence) - 1;
+}
+
+bool IpcClient::replayMissedUpdates (juce::uint32 origin, juce::int64 lastReceived)
+{
+    const auto& log { getReplayLog () };
+    if (log.getMaxBytes () == 0 || origin != getSendingOrigin ())
+        return false;
+    const auto replayed { log.replay (lastReceived,
+                                            [this] (const juce::MemoryBlock& message)
+                                            {
+                                                if (sendToPeer (message))
+                                                    clientProperties.replayedCount++;
+                                            },
+                                            peerOrigin) };
+    // changes waiting in a batch come after the ones we replayed.
+    if (replayed)
+        flush ();
+    return replayed;
+}
+
+bool IpcClient::sendSequenced (juce::int64 sequence, const juce::MemoryBlock& message)
+{
+    replayLog.add (sequence, message);
+    if (!isReadyToSend ())
+        return false;
+    return sendToPeer (message);
+}
+
+void IpcClient::setCompression (bool shouldCompress, int minimumSize)
+{
+    const auto turnedOn { shouldCompress && !compression };
+    compression        = shouldCompress;
+    compressionMinimum = juce::jmax (0, minimumSize);
+    if (turnedOn && clientProperties.connected)
+        sendCompressionOffer ();
+}
+
+void IpcClient::sendCompressionOffer ()
+{
+    juce::MemoryOutputStream output;
+    output.writeByte (static_cast<char> (ControlMessage::compressionOffer));
+    sendToPeer (output.getMemoryBlock ());
+}
+
+juce::MemoryBlock IpcClient::compress (const juce::MemoryBlock& message)
+{
+    if (!shouldCompressMessage (message.getSize ()))
+        return {};
+
+    const auto start { juce::Time::getMillisecondCounterHiRes () };
+    auto compressed { compressMessage (message) };
+    recordCompression (message.getSize (), compressed.getSize (), juce::Time::getMillisecondCounterHiRes () - start);
+    return compressed;
+}
+
+bool IpcClient::shouldCompressMessage (size_t size) const
+{
+    return compression && peerCompresses && size >= static_cast<size_t> (compressionMinimum);
+}
+
+void IpcClient::recordCompression (size_t uncompressedSize, size_t compressedSize, double ms)
+{
+    clientProperties.compressionMs += ms;
+    // (a message that doesn't compress is sent as it is.)
+    if (compressedSize == 0)
+        return;
+
+    uncompressedBytes += static_cast<juce::int64> (uncompressedSize);
+    compressedBytes += static_cast<juce::int64> (compressedSize);
+    clientProperties.compressedCount++;
+    clientProperties.compressionRatio = static_cast<double> (uncompressedBytes) / static_cast<double> (compressedBytes);
+}
+
+void IpcClient::discardBatch ()
+{
+    if (batchTimer != nullptr)
+        batchTimer->stopTimer ();
+    batch.reset ();
+    batchCount = 0;
+}
+
+void IpcClient::addToBatch (const void* encodedChange, size_t encodedSize)
+{
+    if (batchCount == 0)
+        batch.writeRepeatedByte (0, batchHeaderSize);
+    batch.writeCompressedInt (static_cast<int> (encodedSize));
+    batch.write (encodedChange, encodedSize);
+    ++batchCount;
+
+    if (batch.getDataSize () >= static_cast<size_t> (batchBytes))
+        flush ();
+    else if (!batchTimer->isTimerRunning ())
+        batchTimer->startTimer (batchDelay);
+}
+
+void IpcClient::sendManifest (juce::uint8 messageType)
+{
+    juce::MemoryOutputStream output;
+    output.writeByte (static_cast<char> (messageType));
+    // the last update we have, so the other end may be able to send just the
+    // ones we missed.
+    output.writeInt (static_cast<int> (sequenceTracker.hasSender () ? sequenceTracker.getLastOrigin () : 0));
+    output.writeInt64 (sequenceTracker.getLastSequence ());
+    // (so that a server doesn't replay our own changes back to us.)
+    output.writeInt (static_cast<int> (getSendingOrigin ()));
+    ContentManifest::create (syncObject, syncObject.getContentHashCache ()).writeToStream (output);
+    sendToPeer (output.getMemoryBlock ());
+}
+
+bool IpcClient::sendToPeer (const juce::MemoryBlock& message)
+{
+    const auto compressed { compress (message) };
+    return transmit (compressed.isEmpty () ? message : compressed);
+}
+
+bool IpcClient::transmit (const juce::MemoryBlock& message)
+{
+    if (sharedMemoryChannel != nullptr)
+        return sharedMemoryChannel->sendMessage (message.getData (), message.getSize ());
+    return sendMessage (message);
+}
+
+bool IpcClient::sendUpdate (juce::uint8 messageType, const void* data, size_t size)
+{
+    // (a server's connections only send replies to manifests.)
+    const auto sequenced { messageType == ControlMessage::sequencedUpdate };
+    jassert (!sequenced || server == nullptr);
+    const auto sequence { sequenced ? nextSequence++ : getLastSentSequence () };
+    juce::MemoryOutputStream output { size + sequencedHeaderSize };
+    writeSequencedHeader (output, messageType, getSendingOrigin (), sequence);
+    if (size > 0)
+        output.write (data, size);
+    if (sequenced)
+        return sendSequenced (sequence, output.getMemoryBlock ());
+    return sendToPeer (output.getMemoryBlock ());
+}
+
+bool IpcClient::isReadyToSend () const
+{
+    return (update & UpdateType::send) && clientProperties.connected && !awaitingManifest;
+}
+
+void IpcClient::handleManifest (const juce::MemoryBlock& message)
+{
+    juce::MemoryInputStream input { message, false };
+    input.skipNextBytes (1);
+    const auto origin { static_cast<juce::uint32> (input.readInt ()) };
+    const auto lastReceived { input.readInt64 () };
+    peerOrigin = static_cast<juce::uint32> (input.readInt ());
+
+    // we only answer a manifest sent on connecting if we were asked to send
+    // a full update then, or if we keep a replay log and the other end was
+    // following our updates before; we always answer one sent after a missed
+    // update.
+    const auto isResyncRequest { static_cast<juce::uint8> (message[0]) == ControlMessage::resyncRequest };
+    const auto isResuming { getReplayLog ().getMaxBytes () > 0 && origin == getSendingOrigin () };
+    if (!(awaitingManifest || ((isResyncRequest || isResuming) && (update & UpdateType::send))))
+        return;
+    awaitingManifest = false;
+
+    // if the other end only missed a few updates, send just those.
+    if (replayMissedUpdates (origin, lastReceived))
+        return;
+    // our reply will include any changes that are waiting to be sent.
+    discardBatch ();
+
+    ContentManifest manifest;
+    if (!ContentManifest::readFromStream (input, manifest))
+    {
+        // we don't know what the other end has, so send everything.
+        jassertfalse;
+        juce::MemoryOutputStream fullSync;
+        fullSync.writeByte (static_cast<char> (SyncChangeType::fullSync));
+        static_cast<juce::ValueTree> (syncObject).writeToStream (fullSync);
+        sendUpdate (ControlMessage::resyncUpdate, fullSync.getData (), fullSync.getDataSize ());
+    }
+    else
+    {
+        for (const auto& change : manifest.createUpdates (syncObject, syncObject.getContentHashCache ()))
+        {
+            sendUpdate (ControlMessage::resyncUpdate, change.getData (), change.getSize ());
+            clientProperties.txCount++;
+        }
+    }
+    sendUpdate (ControlMessage::resyncComplete, nullptr, 0);
 }
 
 void IpcClient::messageReceived (const juce::MemoryBlock& message)
 {
-    if (update & UpdateType::receive)
+    if (message.getSize () == 0)
+        return;
+
+    const auto messageType { static_cast<juce::uint8> (message[0]) };
+    if (messageType == ControlMessage::compressedMessage)
+    {
+        juce::MemoryBlock inflated;
+        if (!decompress (message, inflated))
+        {
+            jassertfalse;
+            return;
+        }
+        messageReceived (inflated);
+        return;
+    }
+
+    if (messageType == ControlMessage::compressionOffer)
     {
-        // create an rvalue copy of the message that can be moved from.
+        peerCompresses = true;
+        return;
+    }
+
+    if (messageType == ControlMessage::contentManifest || messageType == ControlMessage::resyncRequest)
+    {
+        handleManifest (message);
+        return;
+    }
+
+    if (!(update & UpdateType::receive))
+        return;
+
+    if (messageType < ControlMessage::firstControlMessage)
+    {
+        // an unsequenced update.
         pushUpdate (juce::MemoryBlock { message });
         clientProperties.rxCount++;
+        return;
+    }
+
+    juce::MemoryInputStream input { message, false };
+    input.skipNextBytes (1);
+    const auto origin { static_cast<juce::uint32> (input.readInt ()) };
+    const auto sequence { input.readInt64 () };
+    const auto headerSize { static_cast<size_t> (input.getPosition ()) };
+    if (headerSize > message.getSize ())
+    {
+        jassertfalse;
+        return;
     }
+
+    switch (messageType)
+    {
+        case ControlMessage::sequencedUpdate:
+        case ControlMessage::batchedUpdate:
+            // until the other end brings us up to date, there's no point in
+            // applying changes to a tree that doesn't match theirs -- unless
+            // it's replaying the updates we missed, starting with this one.
+            if (resyncPending)
+            {
+                if (!sequenceTracker.isNext (origin, sequence))
+                    return;
+                resyncPending = false;
+            }
+            switch (sequenceTracker.check (origin, sequence))
+            {
+                case SequenceTracker::Result::apply:
+                    break;
+                case SequenceTracker::Result::duplicate:
+                    return;
+                case SequenceTracker::Result::gap:
+                    clientProperties.gapCount = sequenceTracker.getGapCount ();
+                    resyncPending             = true;
+                    sendManifest (ControlMessage::resyncRequest);
+                    return;
+            }
+            break;
+        case ControlMessage::resyncUpdate:
+            break;
+        case ControlMessage::resyncComplete:
+            sequenceTracker.reset (origin, sequence);
+            resyncPending = false;
+            return;
+        default:
+            // a message from a newer version of cello?
+            jassertfalse;
+            return;
+    }
+
+    // (an update that only moves the sequence on; the change was our own.)
+    if (message.getSize () == headerSize)
+        return;
+
+    if (messageType == ControlMessage::batchedUpdate)
+    {
+        // applyUpdate() unpacks the batch.
+        if (message.getSize () < batchHeaderSize)
+        {
+            jassertfalse;
+            return;
+        }
+        clientProperties.rxCount += input.readInt ();
+        pushUpdate (juce::MemoryBlock { message });
+        return;
+    }
+
+    pushUpdate (static_cast<const char*> (message.getData ()) + headerSize, message.getSize () - headerSize);
+    clientProperties.rxCount++;
 }
+
 void IpcClient::stateChanged (const void* encodedChange, size_t encodedSize)
 {
-    if ((update & UpdateType::send) && (clientProperties.connected))
+    if (isReadyToSend ())
     {
-        if (updateData != SyncData { encodedChange, encodedSize })
+        if (!updateTag.isEcho (encodedChange, encodedSize))
         {
-            sendMessage ({ encodedChange, encodedSize });
-            clientProperties.txCount++;
+            if (batchBytes > 0)
+                addToBatch (encodedChange, encodedSize);
+            else
+            {
+                sendUpdate (ControlMessage::sequencedUpdate, encodedChange, encodedSize);
+                clientProperties.txCount++;
+            }
         }
     }
+    else if ((update & UpdateType::send) && replayLog.getMaxBytes () > 0)
+    {
+        // log the change so we can send it when the other end (re)connects.
+        if (!updateTag.isEcho (encodedChange, encodedSize))
+            sendUpdate (ControlMessage::sequencedUpdate, encodedChange, encodedSize);
+    }
+}
+
+void ReplayLog::setMaxBytes (size_t maxBytes)
+{
+    maxSize = maxBytes;
+    while (size > maxSize)
+    {
+        size -= entries.front ().message.getSize ();
+        entries.pop_front ();
+    }
+}
+
+void ReplayLog::add (juce::int64 sequence, const juce::MemoryBlock& message, juce::uint32 source,
+                     size_t headerSize)
+{
+    // (there's a gap we can't fill.)
+    if (sequence != lastSequence + 1)
+        clear ();
+    lastSequence = sequence;
+    if (message.getSize () > maxSize)
+    {
+        // it would push everything else out, and then not fit itself.
+        clear ();
+        return;
+    }
+
+    entries.push_back ({ sequence, message, source, headerSize });
+    size += message.getSize ();
+    while (size > maxSize)
+    {
+        size -= entries.front ().message.getSize ();
+        entries.pop_front ();
+    }
+}
+
+bool ReplayLog::replay (juce::int64 lastReceived, const std::function<void (const juce::MemoryBlock&)>& send,
+                        juce::uint32 receiver) const
+{
+    if (lastReceived == lastSequence)
+        return true;
+    if (lastReceived > lastSequence || entries.empty () || entries.front ().sequence > lastReceived + 1)
+        return false;
+
+    for (const auto& entry : entries)
+    {
+        if (entry.sequence <= lastReceived)
+            continue;
+        // the receiver already has its own change.
+        if (receiver != 0 && entry.source == receiver && entry.headerSize > 0)
+            send ({ entry.message.getData (), entry.headerSize });
+        else
+            send (entry.message);
+    }
+    return true;
+}
+
+void ReplayLog::clear ()
+{
+    entries.clear ();
+    size = 0;
+}
+
+SequenceTracker::Result SequenceTracker::check (juce::uint32 origin, juce::int64 sequence)
+{
+    // a different sender (or the same one, restarted.)
+    if (!hasOrigin || origin != lastOrigin)
+    {
+        reset (origin, sequence);
+        return Result::apply;
+    }
+
+    if (sequence <= lastSequence)
+        return Result::duplicate;
+
+    if (sequence == lastSequence + 1)
+    {
+        lastSequence = sequence;
+        return Result::apply;
+    }
+
+    ++gapCount;
+    return Result::gap;
+}
+
+void SequenceTracker::reset (juce::uint32 origin, juce::int64 sequence)
+{
+    hasOrigin    = true;
+    lastOrigin   = origin;
+    lastSequence = sequence;
+}
+
+UpdateTag& IpcClient::getUpdateTag ()
+{
+    return server != nullptr ? server->updateTag : updateTag;
 }
 
 void IpcClient::startUpdate (void* data, size_t size)
 {
-    updateData = SyncData { data, size };
+    if (server != nullptr)
+        server->updatingClient = this;
+    // (a batch's changes are tagged one at a time, as they're applied.)
+    getUpdateTag () = isBatch (data, size) ? UpdateTag {} : UpdateTag { data, size };
 }
 
 void IpcClient::endUpdate ()
 {
-    updateData = SyncData {};
+    if (server != nullptr)
+        server->updatingClient = nullptr;
+    getUpdateTag ().clear ();
+}
+
+void IpcClient::applyUpdate (const void* data, size_t size)
+{
+    if (!isBatch (data, size))
+    {
+        UpdateQueue::applyUpdate (data, size);
+        return;
+    }
+
+    // the changes are applied (and echo) in order, so we only ever need to
+    // recognize the echo of the one we're applying.
+    startUpdate (const_cast<void*> (data), size);
+    forEachBatchedChange (data, size,
+                          [this] (const void* change, size_t changeSize)
+                          {
+                              getUpdateTag () = UpdateTag { change, changeSize };
+                              syncObject.update (change, changeSize);
+                          });
+    endUpdate ();
 }
 
 //==============================================================================
@@ -189,7 +849,8 @@ void IpcServerProperties::stopServer ()
 }
 
 IpcServer::IpcServer (Object& sync, IpcClient::UpdateType updateType, const juce::String& statePath, Object* state)
-: syncObject { sync }
+: juce::ValueTreeSynchroniser { sync }
+, syncObject { sync }
 , update { updateType }
 , serverProperties { statePath, state }
 {
@@ -207,9 +868,11 @@ IpcServer::IpcServer (Object& sync, IpcClient::UpdateType updateType, const juce
 
 IpcServer::~IpcServer ()
 {
+    cancelPendingUpdate ();
     // if the server is running, stop it.
     stopServer ();
     // ...and delete all of the connection objects.
+    const juce::ScopedLock lock { connectionLock };
     connections.clear ();
 }
 
@@ -250,17 +913,132 @@ bool IpcServer::stopServer ()
     return true;
 }
 
+void IpcServer::setCompression (bool shouldCompress, int minimumSize)
+{
+    {
+        const juce::ScopedLock lock { connectionLock };
+        compression        = shouldCompress;
+        compressionMinimum = minimumSize;
+    }
+    // (this may send a message to each connection.)
+    std::vector<IpcClient*> clients;
+    snapshotConnections (clients);
+    for (auto* client : clients)
+        client->setCompression (shouldCompress, minimumSize);
+}
+
+void IpcServer::snapshotConnections (std::vector<IpcClient*>& snapshot)
+{
+    snapshot.clear ();
+    const juce::ScopedLock lock { connectionLock };
+    for (auto& client : connections)
+        snapshot.push_back (client.get ());
+}
+
+void IpcServer::connectionDropped ()
+{
+    triggerAsyncUpdate ();
+}
+
+void IpcServer::handleAsyncUpdate ()
+{
+    // (disconnecting may wait for a connection's thread, so we delete them
+    // without holding the lock.)
+    std::vector<std::unique_ptr<IpcClient>> lost;
+    {
+        const juce::ScopedLock lock { connectionLock };
+        for (auto it { connections.begin () }; it != connections.end ();)
+        {
+            if ((*it)->dropped)
+            {
+                if (updatingClient == it->get ())
+                    updatingClient = nullptr;
+                lost.push_back (std::move (*it));
+                it = connections.erase (it);
+            }
+            else
+                ++it;
+        }
+    }
+    lost.clear ();
+}
+
 juce::InterprocessConnection* IpcServer::createConnectionObject ()
 {
     // create a new IpcConnection object, and take over its ownership;
     // pass back a non-owning pointer to it so the base server class can
     // finish setting up the client connection.
-    auto client { std::make_unique<IpcClient> (syncObject, "", 0, 0, update, &serverProperties) };
+    std::unique_ptr<IpcClient> client {
+        new IpcClient (syncObject, update, "", 0, "", 0, &serverProperties, this)
+    };
     juce::InterprocessConnection* connection { client.get () };
+    const juce::ScopedLock lock { connectionLock };
+    client->setCompression (compression, compressionMinimum);
     connections.push_back (std::move (client));
     return connection;
 }
 
+void IpcServer::setReplayLog (size_t maxBytes)
+{
+    replayLog.setMaxBytes (maxBytes);
+}
+
+void IpcServer::stateChanged (const void* encodedChange, size_t encodedSize)
+{
+    // if one of our connections is applying this change, don't send it back
+    // to that connection, but do pass it on to the others.
+    const auto* source { updateTag.isEcho (encodedChange, encodedSize) ? updatingClient : nullptr };
+    const auto sourceOrigin { source != nullptr ? source->sequenceTracker.getLastOrigin () : 0 };
+
+    // frame the change once, with our origin ID and sequence number, and send
+    // the same message to all of our connections; a connection that's not
+    // ready for it now can be sent it from the log later.
+    const auto sequence { nextSequence++ };
+    juce::MemoryOutputStream output { sequencedHeaderSize + encodedSize };
+    writeSequencedHeader (output, ControlMessage::sequencedUpdate, originId, sequence);
+    output.write (encodedChange, encodedSize);
+    const auto message { output.getMemoryBlock () };
+    // (if the source reconnects before it sees this, it's replayed just the
+    // header.)
+    replayLog.add (sequence, message, sourceOrigin, sequencedHeaderSize);
+
+    // compress the message (once) for the connections that want it that way.
+    juce::MemoryBlock compressed;
+    bool compressedYet { false };
+
+    // a slow connection mustn't hold up accepting new ones.
+    snapshotConnections (sendingTo);
+    for (auto* client : sendingTo)
+    {
+        if (!client->isReadyToSend ())
+            continue;
+        if (client == source)
+        {
+            // it already has the change, but mustn't think it missed one.
+            client->sendToPeer ({ message.getData (), sequencedHeaderSize });
+            continue;
+        }
+
+        const auto* toSend { &message };
+        if (client->shouldCompressMessage (message.getSize ()))
+        {
+            auto ms { 0.0 };
+            if (!compressedYet)
+            {
+                const auto start { juce::Time::getMillisecondCounterHiRes () };
+                compressed    = compressMessage (message);
+                compressedYet = true;
+                ms            = juce::Time::getMillisecondCounterHiRes () - start;
+            }
+            client->recordCompression (message.getSize (), compressed.getSize (), ms);
+            if (!compressed.isEmpty ())
+                toSend = &compressed;
+        }
+        if (client->transmit (*toSend))
+            client->clientProperties.txCount++;
+    }
+}
+
 } // namespace cello
 
 #if RUN_UNIT_TESTS
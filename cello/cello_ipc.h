@@ -19,15 +19,22 @@
 
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <functional>
+
 #include <juce_events/juce_events.h>
 
 #include "cello_object.h"
+#include "cello_shared_memory.h"
 #include "cello_sync.h"
 #include "cello_value.h"
 
 namespace cello
 {
 
+class IpcServer;
+
 /**
  * @brief Properties struct to monitor an IPC client. Created automatically
  * when creating an IpcClient object, and will be named after the cello Object
@@ -42,6 +49,145 @@ struct IpcClientProperties : public Object
     MAKE_VALUE_MEMBER (bool, connected, false);
     MAKE_VALUE_MEMBER (int, rxCount, 0);
     MAKE_VALUE_MEMBER (int, txCount, 0);
+    /// number of times we noticed that we'd missed updates from the other end
+    MAKE_VALUE_MEMBER (int, gapCount, 0);
+    /// number of messages we've compressed (see `IpcClient::setCompression()`)
+    MAKE_VALUE_MEMBER (int, compressedCount, 0);
+    /// the size of the messages we've compressed divided by their size once
+    /// compressed
+    MAKE_VALUE_MEMBER (double, compressionRatio, 1.0);
+    /// total time we've spent compressing messages
+    MAKE_VALUE_MEMBER (double, compressionMs, 0.0);
+    /// number of updates we've re-sent from our replay log (see
+    /// `IpcClient::setReplayLog()`)
+    MAKE_VALUE_MEMBER (int, replayedCount, 0);
+};
+
+/**
+ * @brief Tracks the sequence numbers of the updates we receive from a sender
+ * so we can tell when one went missing.
+ */
+class SequenceTracker
+{
+public:
+    enum class Result
+    {
+        apply,     ///< the next update we expected (or the first from a new sender)
+        duplicate, ///< we've already seen this update
+        gap        ///< we missed at least one update before this one
+    };
+
+    /**
+     * @brief Check an update's sequence number; the update becomes the last
+     * one we've seen if we should apply it.
+     *
+     * @param origin unique ID of the sender
+     * @param sequence update's sequence number from that sender
+     */
+    Result check (juce::uint32 origin, juce::int64 sequence);
+
+    /**
+     * @brief Start expecting the updates that come after this one (e.g. once
+     * a sender has brought us back up to date).
+     */
+    void reset (juce::uint32 origin, juce::int64 sequence);
+
+    juce::int64 getLastSequence () const { return lastSequence; }
+
+    /**
+     * @return true if we've seen an update from any sender.
+     */
+    bool hasSender () const { return hasOrigin; }
+
+    juce::uint32 getLastOrigin () const { return lastOrigin; }
+
+    /**
+     * @return true if this is the update that comes next from the sender
+     * we're tracking.
+     */
+    bool isNext (juce::uint32 origin, juce::int64 sequence) const
+    {
+        return hasOrigin && origin == lastOrigin && sequence == lastSequence + 1;
+    }
+
+    /**
+     * @return number of gaps we've found.
+     */
+    int getGapCount () const { return gapCount; }
+
+private:
+    bool hasOrigin { false };
+    juce::uint32 lastOrigin { 0 };
+    juce::int64 lastSequence { 0 };
+    int gapCount { 0 };
+};
+
+/**
+ * @brief Keeps copies of the most recent updates that we've sent, so a
+ * receiver that missed some of them (e.g. while it was disconnected) can be
+ * sent only the ones it missed.
+ */
+class ReplayLog
+{
+public:
+    /**
+     * @param maxBytes the oldest updates are forgotten to keep the log under
+     *                 this size; 0 keeps nothing.
+     */
+    void setMaxBytes (size_t maxBytes);
+
+    size_t getMaxBytes () const { return maxSize; }
+
+    /**
+     * @return the size of the updates we're keeping.
+     */
+    size_t getSize () const { return size; }
+
+    /**
+     * @brief Keep a copy of an update that we sent. If its sequence number
+     * doesn't follow the last one we kept, the log starts over.
+     *
+     * @param sequence update's sequence number
+     * @param message the message that was sent
+     * @param source origin ID of the sender that the change came from, if it
+     *               came from another end (0 if it was made here.)
+     * @param headerSize size of the message's header, which is all that's
+     *                   replayed to the `source`.
+     */
+    void add (juce::int64 sequence, const juce::MemoryBlock& message, juce::uint32 source = 0,
+              size_t headerSize = 0);
+
+    /**
+     * @brief Pass the updates that come after a receiver's last one to `send`,
+     * in order. The receiver is only sent the header of an update whose change
+     * came from it, so the sequence moves on without it applying the change
+     * a second time.
+     *
+     * @param lastReceived sequence number of the last update the receiver has.
+     * @param send
+     * @param receiver origin ID of the receiver's own updates, if known.
+     * @return false (without calling `send`) if we no longer have all of the
+     *         updates that the receiver missed.
+     */
+    bool replay (juce::int64 lastReceived, const std::function<void (const juce::MemoryBlock&)>& send,
+                 juce::uint32 receiver = 0) const;
+
+    void clear ();
+
+private:
+    struct Entry
+    {
+        juce::int64 sequence;
+        juce::MemoryBlock message;
+        juce::uint32 source;
+        size_t headerSize;
+    };
+
+    std::deque<Entry> entries;
+    size_t size { 0 };
+    size_t maxSize { 0 };
+    /// sequence number of the last update added.
+    juce::int64 lastSequence { 0 };
 };
 
 //==============================================================================
@@ -51,6 +197,19 @@ class IpcClient : public juce::InterprocessConnection,
                   public UpdateQueue
 {
 public:
+    /**
+     * When a connection is made, an end that receives updates sends a manifest
+     * of its tree's content hashes (see `cello::ContentManifest`) to the other
+     * end; if that end has `fullUpdateOnConnect` set, it replies with only the
+     * parts of its tree that differ, rather than the entire tree. (To make
+     * this efficient for large trees, call `trackContentHash (true)` on the
+     * Objects at both ends.)
+     *
+     * Each update carries the ID of the end that sent it and a sequence
+     * number. If the receiving end sees that it missed an update, it ignores
+     * further updates and sends a new manifest so the other end can bring it
+     * back up to date.
+     */
     enum UpdateType
     {
         send                = 0x01,
@@ -66,6 +225,18 @@ public:
         createIfNeeded ///< If pipe exists, use it, otherwise create.
     };
 
+    /**
+     * @brief Identifies a shared memory channel (see `SharedMemoryChannel`)
+     * for connecting to another process on the same machine. Pipes' connect
+     * options apply to these too.
+     */
+    struct SharedMemory
+    {
+        juce::String name;
+        /// bytes in the ring for each direction; both ends must agree.
+        int ringSize { 1 << 20 };
+    };
+
     /**
      * @brief Construct a new Ipc Client object that connects using sockets
      *
@@ -91,17 +262,99 @@ public:
     IpcClient (Object& objectToWatch, const juce::String& pipeName, int msTimeout, UpdateType updateType,
                Object* state = nullptr);
 
+    /**
+     * @brief Construct a new Ipc Client object that connects to another process
+     * on this machine through shared memory instead of a socket or pipe.
+     *
+     * @param objectToWatch Local object to connect over IPC
+     * @param sharedMemory the channel to use
+     * @param msTimeout (mustExist only) how long to wait for the other end to
+     *                  create the channel; -1 == wait forever.
+     * @param updateType see UpdateType
+     * @param state parent object to contain our IpcClientProperties object.
+     */
+    IpcClient (Object& objectToWatch, const SharedMemory& sharedMemory, int msTimeout, UpdateType updateType,
+               Object* state = nullptr);
+
     ~IpcClient () override;
 
     /**
      * @brief Attempt to make a connection to another IpcClient running
      * in another process.
      *
-     * @param option Only meaningful when connecting to a named pipe.
+     * @param option Only meaningful when connecting to a named pipe or shared
+     *               memory.
      * @return bool True if we connected successfully.
      */
     bool connect (ConnectOptions option = ConnectOptions::noOptions);
 
+    /**
+     * @return true if we're connected to the other end, whichever way we
+     * connect to it. (This hides `InterprocessConnection::isConnected()`,
+     * which knows nothing of shared memory.)
+     */
+    bool isConnected () const;
+
+    /**
+     * @brief Close our connection to the other end, whichever way we connect
+     * to it.
+     */
+    void disconnect ();
+
+    /**
+     * @brief Pack the changes we send into batches instead of sending each one
+     * as its own message. A batch is sent once it holds `maxBytes` of
+     * changes, once its first change has waited `maxDelayMs`, or when
+     * `flush()` is called. The other end applies each batch as a single
+     * update.
+     *
+     * (This applies to the changes that we watch for ourselves; connections
+     * made to an `IpcServer` send the changes that the server encodes.)
+     *
+     * @param maxBytes size of the changes that fills a batch; 0 turns
+     *                 batching off, sending any changes that are waiting.
+     * @param maxDelayMs longest time a change waits to be sent.
+     */
+    void setBatching (int maxBytes, int maxDelayMs = 10);
+
+    /**
+     * @brief Send the changes that are waiting in the current batch now.
+     */
+    void flush ();
+
+    /**
+     * @brief Compress the messages we send (with zlib) that are at least
+     * `minimumSize` bytes, so large updates like a full sync on connecting
+     * take less time to send over a network.
+     *
+     * Compression is negotiated when we connect: we only compress messages
+     * if the other end has turned compression on too. (An end that doesn't
+     * compress still decompresses the messages it receives.) The number of
+     * messages compressed, the compression ratio and the time spent
+     * compressing are published in our IpcClientProperties.
+     *
+     * @param shouldCompress
+     * @param minimumSize smaller messages (like most property changes) are
+     *                    sent uncompressed.
+     */
+    void setCompression (bool shouldCompress, int minimumSize = 512);
+
+    /**
+     * @brief Keep a log of the most recent updates we send (including changes
+     * made while we're disconnected, which are logged to be sent later). When
+     * the other end reconnects, or misses an update, it tells us the last
+     * update it has, and if the log still holds every update after that one
+     * we send just those, instead of bringing it up to date from its
+     * manifest.
+     *
+     * (The connections that an `IpcServer` accepts send the updates that the
+     * server encodes, so the server keeps their log; see
+     * `IpcServer::setReplayLog()`.)
+     *
+     * @param maxBytes size of the log; 0 turns it off.
+     */
+    void setReplayLog (size_t maxBytes);
+
 private:
     friend class IpcServer;
     /**
@@ -114,9 +367,12 @@ private:
      * @param pipeName
      * @param msTimeout
      * @param state
+     * @param owner the server that accepted this connection, if any. The
+     *              server encodes changes to the tree and sends them to each
+     *              of its connections, so we don't watch the tree ourselves.
      */
     IpcClient (Object& objectToWatch, UpdateType updateType, const juce::String& hostName, int portNum,
-               const juce::String& pipeName, int msTimeout, Object* state = nullptr);
+               const juce::String& pipeName, int msTimeout, Object* state = nullptr, IpcServer* owner = nullptr);
 
     void connectionMade () override;
     void connectionLost () override;
@@ -128,6 +384,136 @@ private:
      */
     void messageReceived (const juce::MemoryBlock& message) override;
 
+    /**
+     * @brief Send a manifest of our tree's contents to the other end so it can
+     * bring us up to date.
+     *
+     * @param messageType whether we're connecting or missed an update
+     */
+    void sendManifest (juce::uint8 messageType);
+
+    /**
+     * @brief If our replay log holds every update that the other end missed,
+     * send them.
+     *
+     * @param origin ID of the last sender the other end heard from
+     * @param lastReceived sequence number of the last update it has from them
+     * @return true if the other end is now up to date.
+     */
+    bool replayMissedUpdates (juce::uint32 origin, juce::int64 lastReceived);
+
+    /**
+     * @brief Send a sequenced update that's already been framed, keeping a
+     * copy in our replay log; if we're not connected, it's only logged.
+     *
+     * @param sequence the update's sequence number
+     * @param message
+     * @return true if the message was sent.
+     */
+    bool sendSequenced (juce::int64 sequence, const juce::MemoryBlock& message);
+
+    /**
+     * @brief Tell the other end that we'll compress the messages we send, so
+     * it can compress the messages it sends us.
+     */
+    void sendCompressionOffer ();
+
+    /**
+     * @brief Compress a message that's large enough (if compression has been
+     * negotiated.)
+     *
+     * @param message
+     * @return the compressed message, or an empty block to send `message`
+     *         as it is.
+     */
+    juce::MemoryBlock compress (const juce::MemoryBlock& message);
+
+    /**
+     * @return true if we compress messages of this size.
+     */
+    bool shouldCompressMessage (size_t size) const;
+
+    /**
+     * @brief Publish the sizes of a message we compressed, and the time it
+     * took.
+     *
+     * @param uncompressedSize
+     * @param compressedSize 0 if it didn't get any smaller (so we sent it as
+     *                       it was.)
+     * @param ms
+     */
+    void recordCompression (size_t uncompressedSize, size_t compressedSize, double ms);
+
+    /**
+     * @brief Send a message to the other end (compressing it, if we should)
+     * over whichever connection we're using.
+     *
+     * @param message
+     * @return true if the message was sent.
+     */
+    bool sendToPeer (const juce::MemoryBlock& message);
+
+    /**
+     * @brief Send a message to the other end exactly as it is.
+     *
+     * @param message
+     * @return true if the message was sent.
+     */
+    bool transmit (const juce::MemoryBlock& message);
+
+    /**
+     * @brief Send an update with our origin ID and the next sequence number,
+     * or a reply to a manifest (which doesn't use up a sequence number, but
+     * carries the last one we sent, so the other end knows where to carry on
+     * from.)
+     *
+     * @param messageType
+     * @param data ValueTreeSynchroniser message to send
+     * @param size
+     * @return true if the message was sent.
+     */
+    bool sendUpdate (juce::uint8 messageType, const void* data, size_t size);
+
+    /**
+     * @return true if changes to the tree should be sent to the other end now.
+     */
+    bool isReadyToSend () const;
+
+    /**
+     * @return the log of the updates we send (our server's, if we have one.)
+     */
+    const ReplayLog& getReplayLog () const;
+
+    /**
+     * @return the origin ID that the updates we send carry (our server's, if
+     * we have one.)
+     */
+    juce::uint32 getSendingOrigin () const;
+
+    /**
+     * @return sequence number of the last update we sent (or our server sent.)
+     */
+    juce::int64 getLastSentSequence () const;
+
+    /**
+     * @brief Add a change to the batch we're filling, sending the batch if
+     * it's full.
+     */
+    void addToBatch (const void* encodedChange, size_t encodedSize);
+
+    /**
+     * @brief Forget the changes waiting in the current batch.
+     */
+    void discardBatch ();
+
+    /**
+     * @brief Bring the other end up to date by sending it the parts of our tree
+     * that don't match the manifest it sent us.
+     *
+     * @param message the manifest
+     */
+    void handleManifest (const juce::MemoryBlock& message);
+
     /**
      * @brief When the tree we're connected to changes, send those changes to the
      * other end (if we're connected and should be sending updates.)
@@ -140,8 +526,24 @@ private:
     void startUpdate (void* data, size_t size) override; 
     void endUpdate () override; 
 
+    /**
+     * @brief Apply an update from the queue; a batch's changes are all
+     * applied between one pair of `startUpdate()`/`endUpdate()` calls, each
+     * one tagged as it's applied.
+     */
+    void applyUpdate (const void* data, size_t size) override;
+
+    /**
+     * @return the tag for the change we're applying (kept by our server, if
+     * we have one, since it's the server that sees the change's echo.)
+     */
+    UpdateTag& getUpdateTag ();
+
 
 private:
+    /// @brief The Object we're replicating.
+    Object& syncObject;
+
     /// @brief An Object that we can use to connect to the rest of an application.
     IpcClientProperties clientProperties;
 
@@ -156,8 +558,54 @@ private:
     const juce::String pipe;
     /// receive timeout in ms.
     const int timeout;
-
-    SyncData updateData;
+    /// (shared memory only) the channel we use instead of a socket or pipe.
+    std::unique_ptr<SharedMemoryChannel> sharedMemoryChannel;
+
+    /// the change we're applying, so we don't echo it back.
+    UpdateTag updateTag;
+
+    /// when batching, the size of the changes that fills a batch (or 0), and
+    /// the longest a change waits to be sent.
+    int batchBytes { 0 };
+    int batchDelay { 10 };
+    /// the batch we're filling, with room at the start for its header.
+    juce::MemoryOutputStream batch;
+    int batchCount { 0 };
+    class BatchTimer;
+    std::unique_ptr<BatchTimer> batchTimer;
+
+    /// do we compress messages, and what's the smallest one we compress?
+    bool compression { false };
+    int compressionMinimum { 512 };
+    /// the other end has turned on compression too.
+    bool peerCompresses { false };
+    /// sizes of the messages we've compressed, before and after.
+    juce::int64 uncompressedBytes { 0 };
+    juce::int64 compressedBytes { 0 };
+
+    /// the server that accepted this connection, and sends our updates.
+    IpcServer* server;
+    /// (a server's connection) we've been disconnected, and the server can
+    /// delete us.
+    std::atomic<bool> dropped { false };
+
+    /// we've connected and need to bring the other end up to date once we
+    /// know what it has; until then, there's no point in sending changes.
+    bool awaitingManifest { false };
+
+    /// identifies the updates that we send
+    const juce::uint32 originId;
+    /// sequence number of the next update we send
+    juce::int64 nextSequence { 1 };
+    /// recent updates that we've sent
+    ReplayLog replayLog;
+    /// sequence numbers of the updates we receive
+    SequenceTracker sequenceTracker;
+    /// origin ID of the other end's own updates, from its last manifest.
+    juce::uint32 peerOrigin { 0 };
+    /// we missed an update, and are waiting for the other end to bring us
+    /// back up to date.
+    bool resyncPending { false };
 };
 
 //==============================================================================
@@ -212,7 +660,27 @@ struct IpcServerProperties : public Object
 
 //==============================================================================
 
-class IpcServer : public juce::InterprocessConnectionServer
+/**
+ * @class IpcServer
+ * @brief Accepts socket connections from IpcClients and keeps each of them in
+ * sync with an Object.
+ *
+ * The server watches the Object itself, so a change is encoded only once no
+ * matter how many clients are connected; the same message, with the server's
+ * origin ID and sequence number, is then sent to each connected client that
+ * sends updates. A change that arrived from one client is passed on to all of
+ * the others, but not echoed back to it (it's only told that the sequence
+ * number moved on.)
+ *
+ * Since every connection is sent the same updates, the server keeps a single
+ * replay log for all of them (see `setReplayLog()`), so a client that drops
+ * its connection and reconnects is sent only the updates it missed. A
+ * connection that's been lost is deleted (on the message thread), and a
+ * client that reconnects gets a new one.
+ */
+class IpcServer : public juce::InterprocessConnectionServer,
+                  private juce::ValueTreeSynchroniser,
+                  private juce::AsyncUpdater
 {
 public:
     IpcServer (Object& sync, IpcClient::UpdateType updateType, const juce::String& statePath, Object* state = nullptr);
@@ -235,6 +703,26 @@ public:
      */
     bool stopServer ();
 
+    /**
+     * @brief Turn compression on or off for all of our connections, including
+     * the ones we make from now on; see `IpcClient::setCompression()`. Each
+     * change is compressed once, for all of the connections that compress.
+     *
+     * @param shouldCompress
+     * @param minimumSize
+     */
+    void setCompression (bool shouldCompress, int minimumSize = 512);
+
+    /**
+     * @brief Keep a log of the most recent updates we send to our
+     * connections. When a client reconnects (or misses an update) and the log
+     * still holds every update after the last one it has, it's sent just
+     * those; see `IpcClient::setReplayLog()`.
+     *
+     * @param maxBytes size of the log; 0 turns it off.
+     */
+    void setReplayLog (size_t maxBytes);
+
 protected:
     /**
      * @brief When we get a connection, the base server class will call this so
@@ -249,14 +737,66 @@ protected:
     juce::InterprocessConnection* createConnectionObject () override;
 
 private:
+    friend class IpcClient;
+
+    /**
+     * @brief Encode a change to the Object once, and send it to each of our
+     * connections that should receive it.
+     *
+     * @param encodedChange
+     * @param encodedSize
+     */
+    void stateChanged (const void* encodedChange, size_t encodedSize) override;
+
+    /**
+     * @brief Copy the list of our connections, so we can send to them without
+     * holding `connectionLock` (and making new connections wait for a slow
+     * one.) Call on the message thread: lost connections are only deleted
+     * there (or along with the server), so the pointers stay valid.
+     *
+     * @param snapshot
+     */
+    void snapshotConnections (std::vector<IpcClient*>& snapshot);
+
+    /**
+     * @brief Called by a connection when it's lost, so that it can be
+     * deleted (once it's finished handling the event.)
+     */
+    void connectionDropped ();
+
+    /**
+     * @brief Delete the connections that have been lost.
+     */
+    void handleAsyncUpdate () override;
+
     /// @brief Object being replicated over the IPC link
     Object& syncObject;
 
     /// @brief Do we generate or receive updates? Do we send a full update on connect?
     IpcClient::UpdateType update;
 
+    /// @brief compression settings for our connections
+    bool compression { false };
+    int compressionMinimum { 512 };
+
     /// @brief Owning pointers to the connection objects we create
-    std::vector<std::unique_ptr<juce::InterprocessConnection>> connections;
+    std::vector<std::unique_ptr<IpcClient>> connections;
+    /// connections are created on the server's thread.
+    juce::CriticalSection connectionLock;
+    /// (reused) the connections we're sending a change to.
+    std::vector<IpcClient*> sendingTo;
+
+    /// the change that a connection is applying, and the connection, so we
+    /// don't echo it back.
+    UpdateTag updateTag;
+    IpcClient* updatingClient { nullptr };
+
+    /// identifies the updates that we send to all of our connections
+    const juce::uint32 originId { static_cast<juce::uint32> (juce::Random::getSystemRandom ().nextInt ()) };
+    /// sequence number of the next update we send
+    juce::int64 nextSequence { 1 };
+    /// recent updates that we've sent, for all of our connections
+    ReplayLog replayLog;
 
     /// @brief The Object we use to interact with the app, will have a child
     /// IpcClientProperties object for each connection made.
@@ -19,6 +19,7 @@
 
 #include "JuceHeader.h"
 
+#include "cello_diff.h"
 #include "cello_object.h"
 
 namespace cello
@@ -42,6 +43,18 @@ Object::Object (const juce::String& type, juce::ValueTree tree)
     wrap (type, static_cast<juce::ValueTree> (tree));
 }
 
+Object::Object (const CompiledPath::Ptr& type, const Object* state)
+: Object { type, (state != nullptr ? static_cast<juce::ValueTree> (*state) : juce::ValueTree ()) }
+{
+    if (state != nullptr)
+        undoManager = state->getUndoManager ();
+}
+
+Object::Object (const CompiledPath::Ptr& type, juce::ValueTree tree)
+{
+    wrap (type, tree);
+}
+
 Object::Object (const juce::String& type, juce::File file, Object::FileFormat format)
 : Object { type, Object::load (file, format) }
 {
@@ -52,12 +65,12 @@ Object::Object (const Object& rhs)
 , undoManager { rhs.undoManager }
 {
     // register to receive callbacks when the tree changes.
-    data.addListener (this);
+    bind ();
 }
 
 Object::CreationType Object::wrap (const Object& other)
 {
-    data.removeListener (this);
+    unbind ();
     const auto result { wrap (getType ().toString (), other) };
     undoManager = other.getUndoManager ();
     return result;
@@ -71,9 +84,26 @@ Object& Object::operator= (const Object& rhs)
     return *this;
 }
 
+juce::MemoryBlock Object::assignMinimal (const Object& rhs, const juce::Identifier& key)
+{
+    // can't change this object's type by doing this.
+    jassert (getType () == rhs.getType ());
+    Diff diff { key };
+    return diff.apply (data, rhs.data, getUndoManager ());
+}
+
+bool Object::applyPatch (const juce::MemoryBlock& patch)
+{
+    return Diff::applyPatch (data, patch, getUndoManager ());
+}
+
 Object::~Object ()
 {
-    data.removeListener (this);
+    unbind ();
+
+    // don't leave a dangling pointer in a removal batch that's in progress.
+    for (auto* batch { RemovalBatch::current }; batch != nullptr; batch = batch->previous)
+        std::replace (batch->objects.begin (), batch->objects.end (), this, static_cast<Object*> (nullptr));
 }
 
 juce::ValueTree Object::clone (bool deep) const
@@ -88,7 +118,19 @@ juce::ValueTree Object::clone (bool deep) const
 
 void Object::update (const juce::MemoryBlock& updateBlock)
 {
-    juce::ValueTreeSynchroniser::applyChange (data, updateBlock.getData (), updateBlock.getSize (), getUndoManager ());
+    update (updateBlock.getData (), updateBlock.getSize ());
+}
+
+void Object::update (const void* updateData, size_t updateSize)
+{
+    const juce::ValueTree previous { data };
+    juce::ValueTreeSynchroniser::applyChange (data, updateData, updateSize, getUndoManager ());
+    // a full sync replaces our tree; follow it to the new one.
+    if (data != previous)
+    {
+        bind ();
+        valueTreeRedirected (data);
+    }
 }
 
 juce::ValueTree Object::find (const cello::Query& query, bool deep)
@@ -101,9 +143,14 @@ juce::ValueTree Object::findOne (const cello::Query& query, bool deep)
     return query.search (data, deep, true);
 }
 
-int Object::remove (const cello::Query& query)
+QueryView Object::view (const cello::Query& query)
+{
+    return query.view (data);
+}
+
+int Object::remove (const cello::Query& query, bool batched)
 {
-    return query.remove (data);
+    return query.remove (data, getUndoManager (), batched);
 }
 
 bool Object::upsert (const Object* object, const juce::Identifier& key, bool deep)
@@ -113,10 +160,17 @@ bool Object::upsert (const Object* object, const juce::Identifier& key, bool dee
 
     const auto val { object->data[key] };
 
-    auto existingItem { data.getChildWithProperty (key, val) };
+    auto existingItem { (keyIndex != nullptr && key == indexKey) ? findByKey (val)
+                                                                  : data.getChildWithProperty (key, val) };
     if (existingItem.isValid ())
     {
-        // we found the match -- update in place.
+        // we found the match -- update in place, unless that wouldn't change
+        // anything. (A deep copy replaces all of the children, so if we're
+        // keeping hashes, it's worth checking first; the hashes can only rule
+        // a match out, so a match is confirmed by comparing the trees.)
+        if (deep && contentHash != nullptr && getContentHash (existingItem) == object->getContentHash () &&
+            existingItem.isEquivalentTo (*object))
+            return true;
         if (deep)
             existingItem.copyPropertiesAndChildrenFrom (*object, getUndoManager ());
         else
@@ -141,6 +195,141 @@ void Object::upsertAll (const Object* parent, const juce::Identifier& key, bool
     }
 }
 
+void Object::setIndexKey (const juce::Identifier& key)
+{
+    indexKey = key;
+    rebuildIndex ();
+    // we may need to (stop) watching our children's properties.
+    bind ();
+}
+
+juce::ValueTree Object::findByKey (const juce::var& keyValue) const
+{
+    if (keyIndex == nullptr)
+    {
+        // you need to call setIndexKey() before looking things up by key!
+        jassertfalse;
+        return {};
+    }
+    // (the index is kept current as our children change.)
+    return (*keyIndex)[keyValue];
+}
+
+void Object::indexChild (const juce::ValueTree& child)
+{
+    const auto* keyValue { child.getPropertyPointer (indexKey) };
+    if (keyValue == nullptr)
+        return;
+
+    if (keyIndex->contains (*keyValue))
+    {
+        // keep the existing entry if it still refers to one of our children.
+        const auto existing { (*keyIndex)[*keyValue] };
+        if (existing.getParent () == data && existing[indexKey] == *keyValue)
+            return;
+    }
+    keyIndex->set (*keyValue, child);
+    if (const auto* identity { getTreeIdentity (child) })
+        indexedKeys[identity] = *keyValue;
+}
+
+void Object::unindexChild (const juce::ValueTree& child)
+{
+    juce::var keyValue;
+    bool found { false };
+    const auto* identity { getTreeIdentity (child) };
+    if (identity != nullptr)
+    {
+        const auto entry { indexedKeys.find (identity) };
+        if (entry != indexedKeys.end ())
+        {
+            keyValue = entry->second;
+            found    = (*keyIndex)[keyValue] == child;
+            indexedKeys.erase (entry);
+        }
+    }
+    else
+    {
+        // (we can't tell trees apart by identity, so look for the entry.)
+        for (juce::HashMap<juce::var, juce::ValueTree>::Iterator it { *keyIndex }; it.next ();)
+        {
+            if (it.getValue () == child)
+            {
+                keyValue = it.getKey ();
+                found    = true;
+                break;
+            }
+        }
+    }
+    if (!found)
+        return;
+
+    keyIndex->remove (keyValue);
+    // another child may share the key that this one had.
+    const auto other { data.getChildWithProperty (indexKey, keyValue) };
+    if (other.isValid () && other != child)
+        indexChild (other);
+}
+
+void Object::rebuildIndex ()
+{
+    indexedKeys.clear ();
+    if (indexKey.isNull ())
+    {
+        keyIndex.reset ();
+        return;
+    }
+
+    keyIndex = std::make_unique<juce::HashMap<juce::var, juce::ValueTree>> (juce::jmax (101, data.getNumChildren ()));
+    for (const auto& child : data)
+        indexChild (child);
+}
+
+juce::uint64 Object::getContentHash () const
+{
+    return contentHash != nullptr ? contentHash->get () : ContentHash::calculate (data);
+}
+
+juce::uint64 Object::getContentHash (const juce::ValueTree& subtree) const
+{
+    return contentHash != nullptr ? contentHash->get (subtree) : ContentHash::calculate (subtree);
+}
+
+void Object::trackContentHash (bool shouldTrack)
+{
+    if (!shouldTrack)
+        contentHash.reset ();
+    else if (contentHash == nullptr)
+        contentHash = std::make_unique<ContentHash> (data);
+}
+
+void Object::listenToSubtree (bool shouldListen)
+{
+    subtreeListener = shouldListen;
+    bind ();
+}
+
+void Object::bind ()
+{
+    // keep our current dispatcher alive so re-attaching to the same tree
+    // reuses it.
+    const auto current { dispatcher };
+    unbind ();
+    dispatcher = Dispatcher::attach (*this);
+
+    if (contentHash != nullptr && contentHash->getTree () != data)
+        contentHash->setTree (data);
+}
+
+void Object::unbind ()
+{
+    if (dispatcher != nullptr)
+    {
+        dispatcher->detach (*this);
+        dispatcher = nullptr;
+    }
+}
+
 void Object::setUndoManager (juce::UndoManager* undo)
 {
     undoManager = undo;
@@ -259,17 +448,104 @@ juce::UndoManager* Object::getUndoManager () const
 
 void Object::onPropertyChange (const juce::Identifier& id, PropertyUpdateFn callback)
 {
-    // replace an existing callback?
-    for (auto& updater : propertyUpdaters)
+    auto& updaters { getPropertyUpdaters (id) };
+    // replace (or remove) an existing callback?
+    if (!updaters.empty () && updaters.front ().token == 0)
     {
-        if (updater.id == id)
+        if (callback != nullptr)
+            updaters.front ().fn = callback;
+        else if (propertyDispatchDepth > 0)
         {
-            updater.fn = callback;
-            return;
+            updaters.front ().fn    = nullptr;
+            propertyUpdatersCleared = true;
         }
+        else
+            updaters.erase (updaters.begin ());
+        return;
+    }
+    // nope, it goes ahead of any added callbacks.
+    if (callback != nullptr)
+        updaters.emplace (updaters.begin (), 0, callback);
+}
+
+int Object::addPropertyChangeCallback (const juce::Identifier& id, PropertyUpdateFn callback)
+{
+    const auto token { ++lastPropertyToken };
+    getPropertyUpdaters (id).emplace_back (token, callback);
+    return token;
+}
+
+void Object::removePropertyChangeCallback (int token)
+{
+    if (token <= 0)
+        return;
+
+    for (auto& [key, updaters] : propertyUpdaters)
+    {
+        for (auto it { updaters.begin () }; it != updaters.end (); ++it)
+        {
+            if (it->token == token)
+            {
+                // (the callback may be the one that's executing.)
+                if (propertyDispatchDepth > 0)
+                {
+                    it->fn                  = nullptr;
+                    propertyUpdatersCleared = true;
+                }
+                else
+                    updaters.erase (it);
+                return;
+            }
+        }
+    }
+}
+
+std::vector<Object::PropertyUpdate>& Object::getPropertyUpdaters (const juce::Identifier& id)
+{
+    return propertyUpdaters[id.getCharPointer ().getAddress ()];
+}
+
+bool Object::callPropertyUpdaters (const juce::Identifier& key, const juce::Identifier& property)
+{
+    const auto found { propertyUpdaters.find (key.getCharPointer ().getAddress ()) };
+    if (found == propertyUpdaters.end () || found->second.empty ())
+        return false;
+
+    // callbacks may add or remove callbacks, so find the next one to call
+    // each time, by token (the list is kept in token order; the map entry
+    // itself is never erased.)
+    auto& updaters { found->second };
+    bool called { false };
+    int lastToken { -1 };
+    ++propertyDispatchDepth;
+    for (;;)
+    {
+        const auto next { std::upper_bound (updaters.begin (), updaters.end (), lastToken,
+                                            [] (int token, const PropertyUpdate& updater)
+                                            { return token < updater.token; }) };
+        if (next == updaters.end ())
+            break;
+        lastToken = next->token;
+        if (next->fn != nullptr)
+        {
+            called = true;
+            next->fn (property);
+        }
+    }
+    if (--propertyDispatchDepth == 0 && propertyUpdatersCleared)
+        prunePropertyUpdaters ();
+    return called;
+}
+
+void Object::prunePropertyUpdaters ()
+{
+    propertyUpdatersCleared = false;
+    for (auto& [key, updaters] : propertyUpdaters)
+    {
+        updaters.erase (std::remove_if (updaters.begin (), updaters.end (),
+                                        [] (const PropertyUpdate& updater) { return updater.fn == nullptr; }),
+                        updaters.end ());
     }
-    // nope, append to the list.
-    propertyUpdaters.emplace_back (id, callback);
 }
 
 void Object::onPropertyChange (const ValueBase& val, PropertyUpdateFn callback)
@@ -352,8 +628,15 @@ juce::Result Object::save (juce::File file, FileFormat format) const
 }
 
 Object::CreationType Object::wrap (const juce::String& type, juce::ValueTree tree)
+{
+    return wrap (CompiledPath::get (type), tree);
+}
+
+Object::CreationType Object::wrap (const CompiledPath::Ptr& type, juce::ValueTree tree)
 {
     creationType = CreationType::wrapped;
+    const auto wasBound { dispatcher != nullptr };
+    const juce::ValueTree previous { data };
     Path path { type };
     // DBG(tree.toXmlString());
     data = path.findValueTree (tree, Path::SearchType::createAll, nullptr);
@@ -361,47 +644,66 @@ Object::CreationType Object::wrap (const juce::String& type, juce::ValueTree tre
     if (path.getSearchResult () == Path::SearchResult::created)
         creationType = CreationType::initialized;
 
+    if (keyIndex != nullptr)
+        rebuildIndex ();
+
     // register to receive callbacks when the tree changes.
-    data.addListener (this);
+    bind ();
+    if (wasBound && data != previous)
+        valueTreeRedirected (data);
     return creationType;
 }
 
 void Object::valueTreePropertyChanged (juce::ValueTree& treeWhosePropertyHasChanged, const juce::Identifier& property)
 {
-    if (treeWhosePropertyHasChanged != data)
-        return;
-    // look for an update callback for this property. Returns true if a callback
-    // was registered and called.
-    auto callUpdaterForProperty = [this] (const juce::Identifier& key, const juce::Identifier& prop) -> bool
+    // a child's key changed -- it can only be found under its new value.
+    if (keyIndex != nullptr && property == indexKey && treeWhosePropertyHasChanged.getParent () == data)
     {
-        for (const auto& updater : propertyUpdaters)
-        {
-            if (updater.id == key)
-            {
-                if (updater.fn != nullptr)
-                    updater.fn (prop);
-                return true;
-            }
-        }
-        return false;
-    };
+        unindexChild (treeWhosePropertyHasChanged);
+        indexChild (treeWhosePropertyHasChanged);
+    }
 
+    if (treeWhosePropertyHasChanged != data)
+        return;
     // first, try to find a callback for that exact property.
-    if (callUpdaterForProperty (property, property))
+    if (callPropertyUpdaters (property, property))
         return;
     // ...then see if a generic callback is registered for the type of the tree.
-    callUpdaterForProperty (getType (), property);
+    callPropertyUpdaters (getType (), property);
 }
 
 void Object::valueTreeChildAdded (juce::ValueTree& parentTree, juce::ValueTree& childTree)
 {
-    if (parentTree == data && onChildAdded != nullptr)
+    if (parentTree != data)
+        return;
+
+    if (keyIndex != nullptr)
+        indexChild (childTree);
+
+    if (onChildAdded != nullptr)
         onChildAdded (childTree, -1, data.indexOf (childTree));
 }
 
 void Object::valueTreeChildRemoved (juce::ValueTree& parentTree, juce::ValueTree& childTree, int index)
 {
-    if (parentTree == data && onChildRemoved != nullptr)
+    if (parentTree != data)
+        return;
+
+    if (keyIndex != nullptr)
+        unindexChild (childTree);
+
+    if (onChildrenRemoved != nullptr)
+    {
+        if (auto* batch { RemovalBatch::find (parentTree) })
+        {
+            // we'll be notified once, when the batch is complete.
+            if (std::find (batch->objects.begin (), batch->objects.end (), this) == batch->objects.end ())
+                batch->objects.push_back (this);
+            return;
+        }
+    }
+
+    if (onChildRemoved != nullptr)
         onChildRemoved (childTree, index, -1);
 }
 
@@ -422,10 +724,53 @@ void Object::valueTreeParentChanged (juce::ValueTree& tree)
 
 void Object::valueTreeRedirected (juce::ValueTree& tree)
 {
-    if (tree == data && onTreeRedirected != nullptr)
+    if (tree != data)
+        return;
+
+    if (keyIndex != nullptr)
+        rebuildIndex ();
+
+    if (onTreeRedirected != nullptr)
         onTreeRedirected ();
 }
 
+//
+//////////////////////////////////////////////////////////////////////////
+//
+
+Object::RemovalBatch::RemovalBatch (const juce::ValueTree& parentTree, const std::vector<juce::ValueTree>& removed,
+                                    const std::vector<int>& oldIndices)
+: parent { parentTree }
+, children { removed }
+, indices { oldIndices }
+, previous { current }
+{
+    current = this;
+}
+
+Object::RemovalBatch::~RemovalBatch ()
+{
+    // stay on the stack while delivering so that Objects destroyed by these
+    // callbacks can still null out their entries, but stop collecting.
+    delivering = true;
+    for (size_t i { 0 }; i < objects.size (); ++i)
+    {
+        if (auto* object { objects[i] }; object != nullptr && object->onChildrenRemoved != nullptr)
+            object->onChildrenRemoved (children, indices);
+    }
+    current = previous;
+}
+
+Object::RemovalBatch* Object::RemovalBatch::find (const juce::ValueTree& tree)
+{
+    for (auto* batch { current }; batch != nullptr; batch = batch->previous)
+    {
+        if (!batch->delivering && batch->parent == tree)
+            return batch;
+    }
+    return nullptr;
+}
+
 } // namespace cello
 
 #if RUN_UNIT_TESTS
@@ -19,15 +19,21 @@
 
 #pragma once
 
+#include <unordered_map>
+
 #include <juce_core/juce_core.h>
 #include <juce_data_structures/juce_data_structures.h>
 
+#include "cello_dispatcher.h"
+#include "cello_hash.h"
+#include "cello_path.h"
 #include "cello_update_source.h"
 
 namespace cello
 {
 class ValueBase;
 class Query;
+class QueryView;
 
 class Object : public UpdateSource,
                public juce::ValueTree::Listener
@@ -87,6 +93,24 @@ public:
      */
     Object (const juce::String& type, juce::ValueTree tree);
 
+    /**
+     * @brief Construct a new Object from a type (or path) that's already been
+     * compiled, following the same logic as the constructors that accept a
+     * type string, but without hashing that string or looking it up in the
+     * shared cache of compiled paths -- use these when creating many objects
+     * in a loop.
+     *
+     * @param type e.g. `CompiledPath::get ("row")`, kept for reuse.
+     * @param state pointer to a cello::Object; pass nullptr to default initialize.
+     */
+    Object (const CompiledPath::Ptr& type, const Object* state);
+
+    /**
+     * @param type
+     * @param tree
+     */
+    Object (const CompiledPath::Ptr& type, juce::ValueTree tree);
+
     /**
      * @brief Construct a new Object by attempting to load it from a file on disk.
      * You can test whether this succeeded by checking the return value of
@@ -126,6 +150,28 @@ public:
      */
     Object& operator= (const Object& rhs);
 
+    /**
+     * @brief Make our tree equivalent to another Object's by applying only the
+     * changes needed (see `cello::Diff`) instead of replacing all of our
+     * properties and children, so listeners, the undo manager and any
+     * synchronisers only see what actually changed.
+     *
+     * @param rhs Object to copy; must be the same type as this one.
+     * @param key property used to match up children of the two trees; pass a
+     *            null Identifier to match children by type and position.
+     * @return juce::MemoryBlock a patch of the changes that were made, which can
+     *         be passed to `applyPatch()` on a replica of this Object.
+     */
+    juce::MemoryBlock assignMinimal (const Object& rhs, const juce::Identifier& key = {});
+
+    /**
+     * @brief Apply a patch created by `assignMinimal()` (or `cello::Diff`).
+     *
+     * @param patch
+     * @return false if the patch couldn't be applied.
+     */
+    bool applyPatch (const juce::MemoryBlock& patch);
+
     /**
      * @brief Destroy the Object object
      * The important thing done here is to remove ourselves as a listener to the
@@ -146,6 +192,49 @@ public:
 
     bool operator!= (const juce::ValueTree& rhs) const noexcept { return data != rhs; }
 
+    /**
+     * @brief Compare the contents of two Objects (rather than whether they
+     * share the same tree) using their content hashes; see `getContentHash()`.
+     *
+     * @param other
+     * @return true if the two trees have equivalent contents.
+     */
+    bool hasSameContent (const Object& other) const { return getContentHash () == other.getContentHash (); }
+
+    /**
+     * @brief Get a hash of the contents of this Object's tree (see
+     * `cello::ContentHash`). If we're tracking our content hash, this is
+     * only recalculated for the parts of the tree that changed since the last
+     * call; otherwise the whole tree is walked each time.
+     *
+     * @return juce::uint64
+     */
+    juce::uint64 getContentHash () const;
+
+    /**
+     * @brief Get the content hash of one of our subtrees.
+     *
+     * @param subtree
+     * @return juce::uint64
+     */
+    juce::uint64 getContentHash (const juce::ValueTree& subtree) const;
+
+    /**
+     * @brief Start (or stop) keeping a cached hash of our tree and each of its
+     * subtrees, updated as the tree changes. This speeds up `getContentHash()`,
+     * `hasSameContent()`, deep `upsert()` calls and reconnecting an `IpcClient`
+     * at the cost of some memory and a little extra work on each change.
+     *
+     * @param shouldTrack
+     */
+    void trackContentHash (bool shouldTrack);
+
+    /**
+     * @return the cache of content hashes we maintain, or nullptr if we
+     * aren't tracking them.
+     */
+    const ContentHash* getContentHashCache () const { return contentHash.get (); }
+
     /**
      * @brief Get the type of this object as a juce::Identifier.
      *
@@ -221,6 +310,15 @@ public:
      */
     void update (const juce::MemoryBlock& updateBlock);
 
+    /**
+     * @brief Apply delta/update generated by the juce::ValueTreeSynchroniser
+     * class directly from a buffer that we don't own.
+     *
+     * @param updateData pointer to the update
+     * @param updateSize size of the update in bytes
+     */
+    void update (const void* updateData, size_t updateSize);
+
     /**
      * @name Database functionality
      */
@@ -248,13 +346,27 @@ public:
      */
     juce::ValueTree findOne (const cello::Query& query, bool deep = false);
 
+    /**
+     * @brief Perform a query against the children of this Object without copying
+     * them, returning a QueryView that refers to the matching children
+     * themselves. Use this instead of `find()` when you only need to look at
+     * (or modify) the results in place.
+     *
+     * @param query Query object that defines the search/sort criteria
+     * @return QueryView
+     */
+    QueryView view (const cello::Query& query);
+
     /**
      * @brief Remove all children from the tree that match the query.
      *
      * @param query
+     * @param batched if true, remove the children as a single undoable step,
+     *        and report the removal through `onChildrenRemoved` (see
+     *        `Query::remove()`)
      * @return int number of children removed.
      */
-    int remove (const cello::Query& query);
+    int remove (const cello::Query& query, bool batched = false);
 
     /**
      * @brief Update or insert a child object (concept borrowed from MongoDB)
@@ -262,6 +374,10 @@ public:
      * object we've been passed. If a match is found, we update the entry in place
      * (update). If no match is found, we append a copy of `object` to our children.
      *
+     * If this object is keeping content hashes (see `trackContentHash()`), a
+     * deep update leaves a matching child alone when it already has the same
+     * content as `object`.
+     *
      * @param object Object with data to update or add
      * @param key property name to use to match the two entries
      * @param deep if true, also copy sub-items from object.
@@ -281,6 +397,35 @@ public:
      * @param deep  copy subtrees as well?
      */
     void upsertAll (const Object* parent, const juce::Identifier& key, bool deep = false);
+
+    /**
+     * @brief Maintain a hash index of this Object's children, keyed on the value
+     * each child has for the `key` property. Once an index exists, `findByKey()`
+     * and any `upsert()` that uses the same key find their match without scanning
+     * the list of children. The index is kept current as children are added,
+     * removed, or have their key property changed.
+     *
+     * Only one property can be indexed at a time, and key values are expected
+     * to be unique; if two children share a key, the index returns one of them.
+     *
+     * @param key property to index children on. Pass a null Identifier to
+     *            discard the index.
+     */
+    void setIndexKey (const juce::Identifier& key);
+
+    /**
+     * @return the property ID our children are indexed on (null if there's no index)
+     */
+    juce::Identifier getIndexKey () const { return indexKey; }
+
+    /**
+     * @brief Use our index to look up the child whose indexed property has the
+     * value `keyValue`. You must call `setIndexKey()` before using this.
+     *
+     * @param keyValue value to look for.
+     * @return juce::ValueTree the matching child, or an invalid tree if none.
+     */
+    juce::ValueTree findByKey (const juce::var& keyValue) const;
     ///@}
 
     /**
@@ -443,6 +588,24 @@ public:
      */
     juce::ValueTree::Listener* getExcludedListener () const { return excludedListener; }
 
+    /**
+     * @brief By default, an Object's `valueTree...()` callbacks are only
+     * executed for changes made to the tree it wraps (and for property changes
+     * of its direct children, if it has a key index). Pass true to also receive
+     * every change made anywhere in that tree's subtree, as a
+     * juce::ValueTree::Listener registered on the tree would. Only do this if
+     * you've overridden one of those callbacks to look at descendants; each
+     * Object doing this is visited for every change in the subtree.
+     *
+     * @param shouldListen
+     */
+    void listenToSubtree (bool shouldListen);
+
+    /**
+     * @return true if this Object receives changes made to its descendants.
+     */
+    bool isListeningToSubtree () const { return subtreeListener; }
+
     /**
      * @name Callbacks
      */
@@ -477,12 +640,86 @@ public:
      */
     void onPropertyChange (const ValueBase& val, PropertyUpdateFn callback);
 
+    /**
+     * @brief Add a callback for a property *alongside* any that are already
+     * registered for it (including the one set with `onPropertyChange()`).
+     * All callbacks for a property are called in the order they were added;
+     * passing the type id of this tree adds a generic callback as described
+     * above.
+     *
+     * @param id the ID of the property to watch.
+     * @param callback function to call on update.
+     * @return int token to pass to `removePropertyChangeCallback()`
+     */
+    int addPropertyChangeCallback (const juce::Identifier& id, PropertyUpdateFn callback);
+
+    /**
+     * @brief Remove a callback that was added with `addPropertyChangeCallback()`.
+     *
+     * @param token value returned when the callback was added.
+     */
+    void removePropertyChangeCallback (int token);
+
     using ChildUpdateFn = std::function<void (juce::ValueTree& child, int oldIndex, int newIndex)>;
 
     ChildUpdateFn onChildAdded;
     ChildUpdateFn onChildRemoved;
     ChildUpdateFn onChildMoved;
 
+    /**
+     * @brief Called once after a batched removal (see `Query::remove()`) with
+     * the children that were removed and the indices they were removed from,
+     * in ascending index order. If this callback is set, `onChildRemoved` is
+     * not called for children removed as part of a batch.
+     */
+    using ChildrenRemovedFn =
+        std::function<void (const std::vector<juce::ValueTree>& children, const std::vector<int>& oldIndices)>;
+
+    ChildrenRemovedFn onChildrenRemoved;
+
+    /**
+     * @class RemovalBatch
+     * @brief RAII object used while removing a group of children from a tree.
+     * Objects wrapping that tree that have an `onChildrenRemoved` callback
+     * hold their notifications until the batch is destroyed, and are then
+     * notified once for the whole group.
+     */
+    class RemovalBatch
+    {
+    public:
+        /**
+         * @param parent tree that children are being removed from
+         * @param children the children that will be removed
+         * @param oldIndices index of each child, in ascending order.
+         */
+        RemovalBatch (const juce::ValueTree& parent, const std::vector<juce::ValueTree>& children,
+                      const std::vector<int>& oldIndices);
+        ~RemovalBatch ();
+
+        RemovalBatch (const RemovalBatch&)            = delete;
+        RemovalBatch& operator= (const RemovalBatch&) = delete;
+
+    private:
+        friend class Object;
+        /**
+         * @brief Find the batch (if any) that's removing children from `tree`
+         * on this thread.
+         */
+        static RemovalBatch* find (const juce::ValueTree& tree);
+
+        juce::ValueTree parent;
+        const std::vector<juce::ValueTree>& children;
+        const std::vector<int>& indices;
+        /// Objects waiting to be notified; entries are nulled if the Object is destroyed.
+        std::vector<Object*> objects;
+        /// batches may nest (e.g. removing from a tree in a removal callback)
+        RemovalBatch* previous { nullptr };
+        /// true once the removal is complete and we're calling back.
+        bool delivering { false };
+
+        static inline thread_local RemovalBatch* current { nullptr };
+    };
+
     using SelfUpdateFn = std::function<void (void)>;
 
     SelfUpdateFn onParentChanged;
@@ -584,6 +821,7 @@ private:
      * @return CreationType
      */
     CreationType wrap (const juce::String& type, juce::ValueTree tree);
+    CreationType wrap (const CompiledPath::Ptr& type, juce::ValueTree tree);
 
     /**
      * @brief Handle property changes in this tree by calling a registered
@@ -660,24 +898,118 @@ protected:
 
 private:
     /**
-     * @brief key/value mapping between a property ID and the callback
-     * to execute when its value is updated. We create a vector of these
-     * structs as update functions are registered, and perform a linear
-     * search of them as needed.
+     * @brief A single registered property callback. The callback installed by
+     * `onPropertyChange()` always uses token 0; callbacks added with
+     * `addPropertyChangeCallback()` get a unique positive token.
      */
     struct PropertyUpdate
     {
-        PropertyUpdate (juce::Identifier id_, PropertyUpdateFn fn_)
-        : id { id_ }
+        PropertyUpdate (int token_, PropertyUpdateFn fn_)
+        : token { token_ }
         , fn { fn_ }
         {
         }
 
-        juce::Identifier id;
+        int token;
         PropertyUpdateFn fn;
     };
 
-    std::vector<PropertyUpdate> propertyUpdaters;
+    /**
+     * @brief Look up (or create) the list of callbacks for a property.
+     *
+     * @param id
+     * @return std::vector<PropertyUpdate>&
+     */
+    std::vector<PropertyUpdate>& getPropertyUpdaters (const juce::Identifier& id);
+
+    /**
+     * @brief Callbacks keyed by the address of each Identifier's pooled
+     * string; identifiers are interned, so equal ids share an address and
+     * dispatch is a single hash lookup regardless of how many properties
+     * have callbacks. Entries are never erased while the Object exists, and
+     * each list is kept in token order. Callbacks removed while callbacks
+     * are being executed are only cleared (see `prunePropertyUpdaters()`),
+     * so a callback may safely add or remove callbacks, including itself.
+     */
+    std::unordered_map<const void*, std::vector<PropertyUpdate>> propertyUpdaters;
+
+    /**
+     * @brief Call the callbacks registered for a property.
+     *
+     * @param key property (or Object type) the callbacks are registered for
+     * @param property the property that changed
+     * @return true if any callback was called.
+     */
+    bool callPropertyUpdaters (const juce::Identifier& key, const juce::Identifier& property);
+
+    /**
+     * @brief Remove the callbacks that were cleared while callbacks were
+     * being executed.
+     */
+    void prunePropertyUpdaters ();
+
+    /// last token handed out by `addPropertyChangeCallback()`
+    int lastPropertyToken { 0 };
+    /// are we executing property callbacks (and how deeply nested)?
+    int propertyDispatchDepth { 0 };
+    /// were callbacks cleared while we were executing callbacks?
+    bool propertyUpdatersCleared { false };
+
+    /**
+     * @brief Add a child to the key index, unless the index already holds a
+     * (still valid) child with the same key value.
+     *
+     * @param child
+     */
+    void indexChild (const juce::ValueTree& child);
+
+    /**
+     * @brief Remove a child's entry from the key index (e.g. because it's been
+     * removed, or its key changed), and index another child that has the same
+     * key, if there is one.
+     *
+     * @param child
+     */
+    void unindexChild (const juce::ValueTree& child);
+
+    /**
+     * @brief Discard and re-create the key index from our current children.
+     */
+    void rebuildIndex ();
+
+    /// property that our children are indexed on, if any.
+    juce::Identifier indexKey;
+
+    /// map from key property values to children; only allocated if an index
+    /// has been requested.
+    std::unique_ptr<juce::HashMap<juce::var, juce::ValueTree>> keyIndex;
+
+    /// the key value that each indexed child is indexed under (by tree
+    /// identity), so its entry can be found once its key has changed.
+    std::unordered_map<const void*, juce::var> indexedKeys;
+
+    /**
+     * @brief Start (or refresh) receiving change events for our tree through
+     * its shared Dispatcher.
+     */
+    void bind ();
+
+    /**
+     * @brief Stop receiving change events for our tree.
+     */
+    void unbind ();
+
+    friend class Dispatcher;
+
+    /// routes change events for our tree to us; Objects don't register
+    /// themselves as listeners directly.
+    Dispatcher::Ptr dispatcher;
+
+    /// see `listenToSubtree()`
+    bool subtreeListener { false };
+
+    /// see `trackContentHash()`
+    std::unique_ptr<ContentHash> contentHash;
 };
 
 } // namespace cello
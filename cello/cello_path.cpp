@@ -52,15 +52,81 @@ juce::ValueTree findAncestor (juce::ValueTree& origin,
     }
 }
 
+/**
+ * @brief Process-wide cache of compiled paths, keyed by path string.
+ */
+struct CompiledPathCache
+{
+    /// if a program generates paths on the fly, don't let the cache grow
+    /// without limit; paths beyond this are compiled but not cached.
+    static constexpr int maxSize { 4096 };
+
+    juce::CriticalSection lock;
+    juce::HashMap<juce::String, cello::CompiledPath::Ptr> paths;
+};
+
+CompiledPathCache& getCompiledPathCache ()
+{
+    static CompiledPathCache cache;
+    return cache;
+}
+
 } // namespace
 
 namespace cello
 {
+CompiledPath::CompiledPath (const juce::String& pathString)
+{
+    auto tokens { juce::StringArray::fromTokens (pathString, Path::sep, "") };
+    // if the path started with our separator '/', re-insert it at the beginning of the
+    // list so our find function works correctly.
+    if (pathString.startsWith (Path::sep))
+        tokens.insert (0, Path::sep);
+
+    segments.reserve (static_cast<size_t> (tokens.size ()));
+    for (const auto& token : tokens)
+    {
+        // get rid of any internal whitespace
+        const auto segment { token.trim () };
+        if (segment == Path::sep)
+            segments.push_back ({ SegmentKind::root, {} });
+        else if (segment == Path::parent)
+            segments.push_back ({ SegmentKind::parent, {} });
+        else if ((segment == Path::current) || (segment.isEmpty ()))
+            segments.push_back ({ SegmentKind::current, {} });
+        else if (segment.startsWith (Path::ancestor))
+        {
+            const auto ancestorType { segment.trimCharactersAtStart (Path::ancestor) };
+            segments.push_back ({ SegmentKind::ancestor,
+                                  ancestorType.isEmpty () ? juce::Identifier {} : juce::Identifier { ancestorType } });
+        }
+        else
+            segments.push_back ({ SegmentKind::child, segment });
+    }
+
+    validRootType = tokens.size () == 1 && juce::Identifier::isValidIdentifier (tokens[0].trim ());
+}
+
+CompiledPath::Ptr CompiledPath::get (const juce::String& pathString)
+{
+    auto& cache { getCompiledPathCache () };
+    const juce::ScopedLock lock { cache.lock };
+    // (a path that isn't cached comes back as nullptr.)
+    if (auto cachedPath { cache.paths[pathString] })
+        return cachedPath;
+
+    auto compiledPath { std::make_shared<const CompiledPath> (pathString) };
+    if (cache.paths.size () < CompiledPathCache::maxSize)
+        cache.paths.set (pathString, compiledPath);
+    return compiledPath;
+}
+
 juce::ValueTree Path::findValueTree (juce::ValueTree& origin, Path::SearchType searchType,
                                      juce::UndoManager* undo)
 {
+    const auto& segments { compiled->getSegments () };
     // nothing to look for!
-    if (pathSegments.size () == 0)
+    if (segments.empty ())
         return {};
 
     if (!origin.isValid ())
@@ -68,15 +134,13 @@ juce::ValueTree Path::findValueTree (juce::ValueTree& origin, Path::SearchType s
         // can't query an empty tree
         if (searchType == SearchType::query)
             return {};
-        // can't create a hierarchy starting without a root.
-        if (pathSegments.size () > 1)
-            return {};
-        // We need a real type name, not a relative path character (or garbage)
-        if (!juce::Identifier::isValidIdentifier (pathSegments[0]))
+        // can't create a hierarchy starting without a root, and we need a real
+        // type name, not a relative path character (or garbage)
+        if (!compiled->canCreateRoot ())
             return {};
         // create and return the new root tree.
         searchResult = SearchResult::created;
-        return juce::ValueTree (pathSegments[0]);
+        return juce::ValueTree (segments[0].type);
     }
 
     auto currentTree { origin };
@@ -85,54 +149,50 @@ juce::ValueTree Path::findValueTree (juce::ValueTree& origin, Path::SearchType s
     // tree, treat it the same as "." (current tree) and just return it directly. If
     // it's a different type, fall into the code below that will look for a child
     // tree of the requested type.
-    if (pathSegments.size () == 1 &&
-        (pathSegments[0] == currentTree.getType ().toString ()))
+    if (segments.size () == 1 && segments[0].kind == CompiledPath::SegmentKind::child &&
+        segments[0].type == currentTree.getType ())
         return currentTree;
 
-    for (int i { 0 }; i < pathSegments.size () && currentTree.isValid (); ++i)
+    for (size_t i { 0 }; i < segments.size () && currentTree.isValid (); ++i)
     {
-        const auto& segment { pathSegments[i] };
-        const auto isLastSegment { i == (pathSegments.size () - 1) };
-        if (segment == sep)
+        const auto& segment { segments[i] };
+        const auto isLastSegment { i == (segments.size () - 1) };
+        switch (segment.kind)
         {
-            currentTree = findRoot (origin);
-        }
-        else if (segment == parent)
-        {
-            currentTree = currentTree.getParent ();
-        }
-        else if ((segment == current) || (segment.isEmpty ()))
-        {
-            // do nothing -- current tree remains the same
-        }
-        else if (segment.startsWith (ancestor))
-        {
-            currentTree = findAncestor (
-                currentTree, segment.trimCharactersAtStart (juce::String { ancestor }));
-        }
-        else
-        {
-            // next segment is a child of the current tree
-            auto childTree { currentTree.getChildWithName (segment) };
-            if (searchType == SearchType::query)
-            {
-                currentTree = childTree;
-            }
-            else
+            case CompiledPath::SegmentKind::root:
+                currentTree = findRoot (origin);
+                break;
+
+            case CompiledPath::SegmentKind::parent:
+                currentTree = currentTree.getParent ();
+                break;
+
+            case CompiledPath::SegmentKind::current:
+                // do nothing -- current tree remains the same
+                break;
+
+            case CompiledPath::SegmentKind::ancestor:
+                currentTree = findAncestor (currentTree, segment.type);
+                break;
+
+            case CompiledPath::SegmentKind::child:
             {
-                if (!childTree.isValid ())
+                // next segment is a child of the current tree
+                auto childTree { currentTree.getChildWithName (segment.type) };
+                if (searchType != SearchType::query && !childTree.isValid ())
                 {
                     // doesn't exist...yet. Create and add to the current tree?
                     if (isLastSegment || (searchType == SearchType::createAll))
                     {
-                        childTree = juce::ValueTree (segment);
+                        childTree = juce::ValueTree (segment.type);
                         currentTree.appendChild (childTree, undo);
                         searchResult = SearchResult::created;
                     }
                 }
                 currentTree = childTree;
+                break;
             }
-        };
+        }
     }
     if (searchResult != SearchResult::created)
         searchResult =
@@ -141,21 +201,6 @@ juce::ValueTree Path::findValueTree (juce::ValueTree& origin, Path::SearchType s
     return currentTree;
 }
 
-juce::StringArray Path::parsePathSegments (const juce::String& pathString)
-{
-    auto segments { juce::StringArray::fromTokens (pathString, sep, "") };
-    for (auto& segment : segments)
-    {
-        // get rid of any internal whitespace
-        segment = segment.trim ();
-    }
-    // if the path started with our separator '/', re-insert it at the beginning of the
-    // list so our find function works correctly.
-    if (pathString.startsWith (sep))
-        segments.insert (0, sep);
-    return segments;
-}
-
 } // namespace cello
 #if RUN_UNIT_TESTS
 #include "test/test_cello_path.inl"
@@ -25,6 +25,69 @@
 namespace cello
 {
 
+/**
+ * @class CompiledPath
+ * @brief A path specification (see `Path`, below) that has been parsed once
+ * into its segments, with the type names used in it converted to Identifiers,
+ * so it can be used repeatedly without doing any string work.
+ *
+ * Use `CompiledPath::get()` to retrieve a shared instance from a process-wide
+ * cache; the `Path` constructor that accepts a string does this for you. Code
+ * that creates many Objects of the same type can get the type's compiled path
+ * once and pass it to the `Object` constructor, skipping the cache entirely.
+ */
+class CompiledPath
+{
+public:
+    using Ptr = std::shared_ptr<const CompiledPath>;
+
+    enum class SegmentKind
+    {
+        root,     ///< "/" -- the root of the current tree
+        parent,   ///< ".." -- the parent of the current tree
+        current,  ///< "." or "" -- the current tree
+        ancestor, ///< "^type" -- the nearest ancestor of that type
+        child     ///< "type" -- a child of that type
+    };
+
+    struct Segment
+    {
+        SegmentKind kind;
+        /// type of the ancestor or child tree; null for the other kinds.
+        juce::Identifier type;
+    };
+
+    /**
+     * @brief Parse a path string. Prefer `get()`, which only does this once for
+     * each distinct path string.
+     *
+     * @param pathString
+     */
+    explicit CompiledPath (const juce::String& pathString);
+
+    /**
+     * @brief Get the shared compiled version of a path string, compiling and
+     * caching it the first time it's requested. Safe to call from any thread.
+     *
+     * @param pathString
+     * @return Ptr
+     */
+    static Ptr get (const juce::String& pathString);
+
+    const std::vector<Segment>& getSegments () const { return segments; }
+
+    /**
+     * @return true if this is a single segment whose text is a valid
+     * Identifier, so it can be used to create a new root tree.
+     */
+    bool canCreateRoot () const { return validRootType; }
+
+private:
+    std::vector<Segment> segments;
+
+    bool validRootType { false };
+};
+
 /**
  * @class Path
  * @brief Class to navigate between subtrees that are all connected together.
@@ -56,8 +119,20 @@ public:
     static const inline juce::String current { "." };
 
     Path (const juce::String& pathString)
-    : pathSegments { parsePathSegments (pathString) }
+    : compiled { CompiledPath::get (pathString) }
+    {
+    }
+
+    /**
+     * @brief Construct a Path from a specification that's already been compiled,
+     * skipping the cache lookup.
+     *
+     * @param compiledPath
+     */
+    Path (CompiledPath::Ptr compiledPath)
+    : compiled { std::move (compiledPath) }
     {
+        jassert (compiled != nullptr);
     }
 
     enum class SearchType
@@ -93,15 +168,7 @@ public:
     SearchResult getSearchResult () const { return searchResult; }
 
 private:
-    /**
-     * @brief parse the path string into its segments, cleaning and verifying as needed.
-     *
-     * @param pathString
-     * @return juce::StringArray
-     */
-    juce::StringArray parsePathSegments (const juce::String& pathString);
-
-    const juce::StringArray pathSegments;
+    const CompiledPath::Ptr compiled;
 
     SearchResult searchResult { SearchResult::notFound };
 };
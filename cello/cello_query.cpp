@@ -18,6 +18,63 @@
 */
 
 #include "cello_query.h"
+#include "cello_object.h"
+
+namespace
+{
+juce::ValueTree copyChild (const juce::ValueTree& child, bool deep)
+{
+    auto childCopy { juce::ValueTree { child.getType () } };
+    if (deep)
+        childCopy.copyPropertiesAndChildrenFrom (child, nullptr);
+    else
+        childCopy.copyPropertiesFrom (child, nullptr);
+    return childCopy;
+}
+
+/**
+ * @brief Undoable action that removes a set of children from a tree in a
+ * single step, reporting the removal as one batch.
+ */
+class RemoveChildrenAction : public juce::UndoableAction
+{
+public:
+    RemoveChildrenAction (juce::ValueTree parentTree, std::vector<int>&& indicesToRemove)
+    : parent { parentTree }
+    , indices { std::move (indicesToRemove) }
+    {
+        children.reserve (indices.size ());
+        for (auto index : indices)
+            children.push_back (parent.getChild (index));
+    }
+
+    bool perform () override
+    {
+        cello::Object::RemovalBatch batch { parent, children, indices };
+        // (ValueTree can only remove one child at a time.) Work from the end
+        // of the list, so the remaining indices stay valid and each removal
+        // moves as few of the children after it as possible.
+        for (auto i { indices.size () }; i-- > 0;)
+            parent.removeChild (indices[i], nullptr);
+        return true;
+    }
+
+    bool undo () override
+    {
+        for (size_t i { 0 }; i < indices.size (); ++i)
+            parent.addChild (children[i], indices[i], nullptr);
+        return true;
+    }
+
+    int getSizeInUnits () override { return static_cast<int> (indices.size ()); }
+
+private:
+    juce::ValueTree parent;
+    /// indices of the children to remove, in ascending order.
+    std::vector<int> indices;
+    std::vector<juce::ValueTree> children;
+};
+} // namespace
 
 namespace cello
 {
@@ -40,37 +97,66 @@ Query& Query::addFilter (Predicate filter)
 
 juce::ValueTree Query::search (juce::ValueTree tree, bool deep, bool returnFirstFound) const
 {
-    juce::ValueTree result { type };
-    for (auto child : tree)
+    if (returnFirstFound)
     {
-        if (filter (child))
+        for (const auto& child : tree)
         {
-            auto childCopy { juce::ValueTree { child.getType () } };
-            if (deep)
-                childCopy.copyPropertiesAndChildrenFrom (child, nullptr);
-            else
-                childCopy.copyPropertiesFrom (child, nullptr);
-            if (returnFirstFound)
-                return childCopy;
-            result.appendChild (childCopy, nullptr);
+            if (filter (child))
+                return copyChild (child, deep);
         }
+        return {};
     }
 
-    if (returnFirstFound)
-        return {};
+    return view (tree).clone (deep);
+}
+
+QueryView Query::view (juce::ValueTree tree) const
+{
+    std::vector<juce::ValueTree> matches;
+    matches.reserve (static_cast<size_t> (tree.getNumChildren ()));
+    for (const auto& child : tree)
+    {
+        if (filter (child))
+            matches.push_back (child);
+    }
 
-    return sort (result);
-    // return result;
+    if (sorters.size () > 0)
+        std::stable_sort (matches.begin (), matches.end (),
+                          [this] (const juce::ValueTree& left, const juce::ValueTree& right)
+                          { return compareElements (left, right) < 0; });
+
+    return QueryView { type, std::move (matches) };
 }
 
-int Query::remove (juce::ValueTree tree) const
+int Query::remove (juce::ValueTree tree, juce::UndoManager* undo, bool batched) const
 {
+    if (batched)
+    {
+        std::vector<int> indices;
+        for (int i { 0 }; i < tree.getNumChildren (); ++i)
+        {
+            if (filter (tree.getChild (i)))
+                indices.push_back (i);
+        }
+
+        const auto removed { static_cast<int> (indices.size ()) };
+        if (removed == 0)
+            return 0;
+
+        auto action { std::make_unique<RemoveChildrenAction> (tree, std::move (indices)) };
+        if (undo != nullptr)
+            undo->perform (action.release ());
+        else
+            action->perform ();
+        return removed;
+    }
+
     int removed { 0 };
     for (int i = tree.getNumChildren () - 1; i >= 0; i--)
     {
         if (filter (tree.getChild (i)))
         {
-            tree.removeChild (i, nullptr);
+            tree.removeChild (i, undo);
             removed++;
         }
     }
@@ -114,6 +200,31 @@ int Query::compareElements (const juce::ValueTree& left, const juce::ValueTree&
     }
     return 0;
 }
+//
+//////////////////////////////////////////////////////////////////////////
+//
+
+QueryView::QueryView (const juce::Identifier& resultType, std::vector<juce::ValueTree>&& matchingChildren)
+: type { resultType }
+, matches { std::move (matchingChildren) }
+{
+}
+
+juce::ValueTree QueryView::operator[] (int index) const
+{
+    if (index < 0 || index >= size ())
+        return {};
+    return matches[static_cast<size_t> (index)];
+}
+
+juce::ValueTree QueryView::clone (bool deep) const
+{
+    juce::ValueTree result { type };
+    for (const auto& child : matches)
+        result.appendChild (copyChild (child, deep), nullptr);
+    return result;
+}
+
 } // namespace cello
 
 #if RUN_UNIT_TESTS
@@ -24,6 +24,8 @@
 namespace cello
 {
 
+class QueryView;
+
 class Query
 {
 public:
@@ -88,13 +90,36 @@ public:
      */
     juce::ValueTree search (juce::ValueTree tree, bool deep, bool returnFirstFound = false) const;
 
+    /**
+     * @brief Execute the query without copying anything -- iterate through the
+     * children of `tree`, returning a QueryView that refers to each child that
+     * fulfills the query, sorted according to the sort criteria we've been given.
+     *
+     * @param tree ValueTree to search.
+     * @return QueryView referring to the matching children.
+     */
+    QueryView view (juce::ValueTree tree) const;
+
     /**
      * @brief Remove all children from the tree that match the query.
      *
+     * In batched mode, the children to remove are all found before the tree is
+     * modified, the removal is recorded as a single undoable action, and any
+     * `cello::Object` with an `onChildrenRemoved` callback is notified once
+     * with the full list of removed children instead of once per child.
+     *
+     * (JUCE has no way to remove several children from a tree at once, so
+     * they're still removed one at a time, from the last to the first, and
+     * any plain `juce::ValueTree::Listener` still hears about each one.
+     * Batching changes what cello's callbacks and the undo manager see, not
+     * the cost of the removal itself.)
+     *
      * @param tree
+     * @param undo optional undo manager.
+     * @param batched true to remove all matching children as a single batch.
      * @return int number of children removed.
      */
-    int remove (juce::ValueTree tree) const;
+    int remove (juce::ValueTree tree, juce::UndoManager* undo = nullptr, bool batched = false) const;
 
     /**
      * @brief Add a comparison function to the list we use to sort a list
@@ -148,4 +173,68 @@ private:
     std::vector<Comparison> sorters;
 };
 
+/**
+ * @class QueryView
+ * @brief Non-owning result of a Query. Instead of copying each matching child
+ * into a new result tree as `Query::search()` does, a view holds references to
+ * the live child trees themselves, so iterating through the results of a query
+ * doesn't allocate or copy any of their data. Changes made through the trees
+ * in a view are changes to the original children.
+ *
+ * Call `materialize()` or `clone()` if you need a detached copy of the results.
+ */
+class QueryView
+{
+public:
+    using Iterator = std::vector<juce::ValueTree>::const_iterator;
+
+    Iterator begin () const { return matches.begin (); }
+    Iterator end () const { return matches.end (); }
+
+    /**
+     * @return int number of children that matched the query.
+     */
+    int size () const { return static_cast<int> (matches.size ()); }
+
+    /**
+     * @return true if nothing matched the query.
+     */
+    bool isEmpty () const { return matches.empty (); }
+
+    /**
+     * @brief Get one of the matching children by its (sorted) index.
+     *
+     * @param index
+     * @return juce::ValueTree; will be invalid if the index is out of range.
+     */
+    juce::ValueTree operator[] (int index) const;
+
+    /**
+     * @brief Create a detached tree of the query's result type that contains a
+     * deep copy of each child in the view; equivalent to `clone (true)`.
+     *
+     * @return juce::ValueTree
+     */
+    juce::ValueTree materialize () const { return clone (true); }
+
+    /**
+     * @brief Create a detached tree of the query's result type that contains a
+     * copy of each child in the view, in view order. This is the same result
+     * that `Query::search()` returns.
+     *
+     * @param deep if true, also copy the sub-items of each child.
+     * @return juce::ValueTree
+     */
+    juce::ValueTree clone (bool deep) const;
+
+private:
+    friend class Query;
+    QueryView (const juce::Identifier& resultType, std::vector<juce::ValueTree>&& matchingChildren);
+
+    /// @brief type of the tree we create when copying the results.
+    juce::Identifier type;
+    /// @brief the children that matched the query, in sorted order.
+    std::vector<juce::ValueTree> matches;
+};
+
 } // namespace cello
@@ -0,0 +1,575 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <climits>
+#include <cstring>
+
+#include <juce_events/juce_events.h>
+
+#if JUCE_LINUX || JUCE_ANDROID
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define CELLO_SHARED_MEMORY_FUTEX 1
+#elif JUCE_MAC && __has_include(<os/os_sync_wait_on_address.h>)
+#include <os/os_sync_wait_on_address.h>
+#define CELLO_SHARED_MEMORY_OS_SYNC 1
+#endif
+
+#include "cello_shared_memory.h"
+
+namespace
+{
+// identifies a block of memory as one of our channels.
+constexpr juce::uint32 sharedMemoryMagic { 0xCE110511 };
+constexpr juce::uint32 sharedMemoryVersion { 3 };
+
+// the bytes that hold a message's length in the ring.
+constexpr size_t lengthSize { 4 };
+
+// when the reader thread finds nothing to do this many times in a row, it
+// stops spinning and goes to sleep until the other end wakes it.
+constexpr int maxIdleSpins { 64 };
+
+// the longest the reader sleeps without being woken, in case the other end
+// went away without telling us.
+constexpr int maxWaitMs { 100 };
+
+// how long `create (false)` gives a channel that's still being created by
+// another process to become ready before deciding that it's stale.
+constexpr int createGraceMs { 100 };
+
+// each end's thread beats at least every `maxWaitMs` while it's running; if
+// the other end's heart stops for this long, it's gone (or hung) even if it
+// never detached.
+constexpr int peerTimeoutMs { 2000 };
+
+/**
+ * @brief Sleep until `word` no longer holds `expected` (or the other process
+ * wakes us), or for at most `ms`. Where the OS can't wait on an address in
+ * shared memory, this just sleeps for a millisecond.
+ */
+void waitForWake (std::atomic<juce::uint32>& word, juce::uint32 expected, int ms)
+{
+#if CELLO_SHARED_MEMORY_FUTEX
+    // (not FUTEX_PRIVATE_FLAG -- the other process waits and wakes here too.)
+    timespec timeout { ms / 1000, (ms % 1000) * 1000000L };
+    syscall (SYS_futex, reinterpret_cast<juce::uint32*> (&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+#elif CELLO_SHARED_MEMORY_OS_SYNC
+    if (__builtin_available (macOS 14.4, *))
+    {
+        os_sync_wait_on_address_with_timeout (&word, expected, sizeof (juce::uint32),
+                                              OS_SYNC_WAIT_ON_ADDRESS_SHARED, OS_CLOCK_MACH_ABSOLUTE_TIME,
+                                              static_cast<uint64_t> (ms) * 1000000);
+        return;
+    }
+    juce::Thread::sleep (1);
+#else
+    juce::ignoreUnused (word, expected, ms);
+    juce::Thread::sleep (1);
+#endif
+}
+
+/**
+ * @brief Wake anything in either process that's waiting on `word`.
+ */
+void wakeAll (std::atomic<juce::uint32>& word)
+{
+#if CELLO_SHARED_MEMORY_FUTEX
+    syscall (SYS_futex, reinterpret_cast<juce::uint32*> (&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#elif CELLO_SHARED_MEMORY_OS_SYNC
+    if (__builtin_available (macOS 14.4, *))
+        os_sync_wake_by_address_all (&word, sizeof (juce::uint32), OS_SYNC_WAKE_BY_ADDRESS_SHARED);
+#else
+    juce::ignoreUnused (word);
+#endif
+}
+} // namespace
+
+namespace cello
+{
+
+// These live in memory that's shared between processes, so they have to be
+// lock-free (and not just pretend to be with a hidden mutex.)
+static_assert (std::atomic<juce::uint64>::is_always_lock_free);
+static_assert (std::atomic<juce::uint32>::is_always_lock_free);
+// ...and the OS waits on the address of the value itself.
+static_assert (sizeof (std::atomic<juce::uint32>) == sizeof (juce::uint32));
+
+/**
+ * @brief The read and write positions of one direction's ring. The positions
+ * only ever increase; the offset into the ring is the position modulo its
+ * size. Each is on its own cache line, since they're written by different
+ * processes.
+ */
+struct SharedMemoryChannel::Ring
+{
+    alignas (64) std::atomic<juce::uint64> writePos;
+    alignas (64) std::atomic<juce::uint64> readPos;
+    /// bumped by the writer whenever there's something new for the reader to
+    /// look at; the reader sleeps on it when there's nothing to do.
+    alignas (64) std::atomic<juce::uint32> wakeCount;
+    /// non-zero while the reader is (about to be) asleep, so the writer only
+    /// makes the system call to wake it when it has to.
+    std::atomic<juce::uint32> readerWaiting;
+};
+
+/**
+ * @brief The start of the shared memory; the data for ring 0 (written by the
+ * end that created the channel) and then ring 1 follow it.
+ */
+struct SharedMemoryChannel::Header
+{
+    juce::uint32 magic;
+    juce::uint32 version;
+    juce::uint32 ringSize;
+    /// non-zero while each end is attached.
+    std::atomic<juce::uint32> attached[2];
+    /// bumped by each end's thread every time it goes around its loop.
+    std::atomic<juce::uint32> heartbeat[2];
+    Ring rings[2];
+};
+
+SharedMemoryChannel::SharedMemoryChannel (const juce::String& name, int size, bool callbacksOnMessageThread)
+: juce::Thread ("cello shared memory")
+, channelName (name)
+, ringSize (size)
+, onMessageThread (callbacksOnMessageThread)
+, alive (std::make_shared<std::atomic<bool>> (true))
+{
+    jassert (channelName.isNotEmpty ());
+    jassert (ringSize > static_cast<int> (lengthSize));
+}
+
+SharedMemoryChannel::~SharedMemoryChannel ()
+{
+    *alive = false;
+    close ();
+}
+
+juce::File SharedMemoryChannel::getSegmentFile (const juce::String& name)
+{
+    const auto fileName { "cello_" + juce::File::createLegalFileName (name) };
+    // on Linux, this is a RAM-backed filesystem.
+    const juce::File shm { "/dev/shm" };
+    if (shm.isDirectory ())
+        return shm.getChildFile (fileName);
+    return juce::File::getSpecialLocation (juce::File::tempDirectory).getChildFile (fileName);
+}
+
+bool SharedMemoryChannel::create (bool mustNotExist)
+{
+    close ();
+    const auto file { getSegmentFile (channelName) };
+    if (file.exists ())
+    {
+        if (mustNotExist)
+            return false;
+        // join the channel that's already there, unless it's been left behind
+        // by a process that's gone away (or stopped responding.)
+        if (open (createGraceMs))
+        {
+            if (isPeerBeating (3 * maxWaitMs))
+                return true;
+            close ();
+        }
+        if (!file.deleteFile ())
+            return false;
+    }
+
+    // make the file as big as the whole segment.
+    const auto totalSize { sizeof (Header) + 2 * static_cast<size_t> (ringSize) };
+    {
+        juce::FileOutputStream output { file };
+        if (!output.openedOk ())
+            return false;
+        juce::MemoryBlock zeros { 65536, true };
+        for (size_t written { 0 }; written < totalSize; written += zeros.getSize ())
+            output.write (zeros.getData (), juce::jmin (zeros.getSize (), totalSize - written));
+    }
+
+    mapping = std::make_unique<juce::MemoryMappedFile> (file, juce::MemoryMappedFile::readWrite);
+    if (mapping->getData () == nullptr || mapping->getSize () < totalSize)
+    {
+        mapping.reset ();
+        file.deleteFile ();
+        return false;
+    }
+
+    auto* newHeader { static_cast<Header*> (mapping->getData ()) };
+    newHeader->ringSize = static_cast<juce::uint32> (ringSize);
+    newHeader->version  = sharedMemoryVersion;
+    // (the other end doesn't look at anything else until this is set.)
+    std::atomic_thread_fence (std::memory_order_release);
+    newHeader->magic = sharedMemoryMagic;
+    return attach (true);
+}
+
+bool SharedMemoryChannel::open (int msTimeout)
+{
+    close ();
+    const auto file { getSegmentFile (channelName) };
+    const auto totalSize { sizeof (Header) + 2 * static_cast<size_t> (ringSize) };
+    const auto start { juce::Time::getMillisecondCounter () };
+    for (;;)
+    {
+        if (file.getSize () >= static_cast<juce::int64> (totalSize))
+        {
+            mapping = std::make_unique<juce::MemoryMappedFile> (file, juce::MemoryMappedFile::readWrite);
+            auto* existing { static_cast<Header*> (mapping->getData ()) };
+            if (existing != nullptr && mapping->getSize () >= totalSize && existing->magic == sharedMemoryMagic)
+            {
+                std::atomic_thread_fence (std::memory_order_acquire);
+                // both ends need to agree on how the memory is laid out.
+                if (existing->version != sharedMemoryVersion ||
+                    existing->ringSize != static_cast<juce::uint32> (ringSize))
+                {
+                    jassertfalse;
+                    mapping.reset ();
+                    return false;
+                }
+                return attach (false);
+            }
+            mapping.reset ();
+        }
+
+        if (msTimeout >= 0 && juce::Time::getMillisecondCounter () - start >= static_cast<juce::uint32> (msTimeout))
+            return false;
+        juce::Thread::sleep (10);
+    }
+}
+
+bool SharedMemoryChannel::attach (bool creator)
+{
+    side   = creator ? 0 : 1;
+    header = static_cast<Header*> (mapping->getData ());
+
+    // anything that was waiting for us is from an earlier connection.
+    auto& ring { getIncoming () };
+    ring.readPos.store (ring.writePos.load ());
+    readingLength  = true;
+    lengthRead     = 0;
+    wasConnected   = false;
+    peerAttached   = false;
+    peerStale      = false;
+    lastPeerBeat   = header->heartbeat[1 - side].load ();
+    lastPeerBeatMs = juce::Time::getMillisecondCounter ();
+    {
+        const juce::ScopedLock lock { receivedLock };
+        received.clear ();
+    }
+
+    header->attached[side].store (1);
+    wakeReader (getOutgoing ());
+    startThread ();
+    return true;
+}
+
+void SharedMemoryChannel::close ()
+{
+    signalThreadShouldExit ();
+    if (header != nullptr)
+    {
+        // our thread may be asleep waiting for the other end.
+        auto& incoming { getIncoming () };
+        incoming.wakeCount.fetch_add (1);
+        wakeAll (incoming.wakeCount);
+    }
+    stopThread (1000);
+    if (header == nullptr)
+        return;
+
+    header->attached[side].store (0);
+    wakeReader (getOutgoing ());
+    header = nullptr;
+    mapping.reset ();
+    wasConnected = false;
+    if (side == 0)
+        getSegmentFile (channelName).deleteFile ();
+}
+
+bool SharedMemoryChannel::isConnected () const
+{
+    return header != nullptr && header->attached[1 - side].load () != 0 && !peerStale.load ();
+}
+
+bool SharedMemoryChannel::isPeerBeating (int msTimeout)
+{
+    const auto& beat { header->heartbeat[1 - side] };
+    const auto start { beat.load () };
+    const auto startMs { juce::Time::getMillisecondCounter () };
+    while (header->attached[1 - side].load () != 0)
+    {
+        if (beat.load () != start)
+            return true;
+        if (juce::Time::getMillisecondCounter () - startMs >= static_cast<juce::uint32> (msTimeout))
+            return false;
+        // (if its thread is asleep, this makes it beat now.)
+        wakeReader (getOutgoing ());
+        juce::Thread::sleep (1);
+    }
+    return false;
+}
+
+void SharedMemoryChannel::watchPeer ()
+{
+    const auto beat { header->heartbeat[1 - side].load () };
+    const auto now { juce::Time::getMillisecondCounter () };
+    if (beat != lastPeerBeat || header->attached[1 - side].load () == 0)
+    {
+        lastPeerBeat   = beat;
+        lastPeerBeatMs = now;
+        peerStale      = false;
+    }
+    else if (now - lastPeerBeatMs > static_cast<juce::uint32> (peerTimeoutMs))
+        peerStale = true;
+}
+
+SharedMemoryChannel::Ring& SharedMemoryChannel::getOutgoing () const
+{
+    return header->rings[side];
+}
+
+SharedMemoryChannel::Ring& SharedMemoryChannel::getIncoming () const
+{
+    return header->rings[1 - side];
+}
+
+juce::uint8* SharedMemoryChannel::getData (const Ring& ring) const
+{
+    const auto index { static_cast<size_t> (&ring - header->rings) };
+    return reinterpret_cast<juce::uint8*> (header) + sizeof (Header) + index * static_cast<size_t> (ringSize);
+}
+
+bool SharedMemoryChannel::sendMessage (const void* data, size_t size)
+{
+    if (!isConnected () || size > 0xffffffff)
+        return false;
+
+    juce::uint8 length[lengthSize];
+    juce::ByteOrder::writeLittleEndianInt (length, static_cast<juce::uint32> (size));
+
+    auto& ring { getOutgoing () };
+    auto* ringData { getData (ring) };
+    const auto capacity { static_cast<juce::uint64> (ringSize) };
+    auto write = [&] (const juce::uint8* bytes, size_t count)
+    {
+        int idle { 0 };
+        while (count > 0)
+        {
+            const auto writePos { ring.writePos.load (std::memory_order_relaxed) };
+            const auto space { capacity - (writePos - ring.readPos.load (std::memory_order_acquire)) };
+            if (space == 0)
+            {
+                // wait for the other end to read something.
+                if (!isConnected ())
+                    return false;
+                if (++idle < maxIdleSpins)
+                    juce::Thread::yield ();
+                else
+                    juce::Thread::sleep (1);
+                continue;
+            }
+            idle = 0;
+
+            // copy as much as fits, in up to two pieces if we wrap around.
+            const auto chunk { static_cast<size_t> (juce::jmin (static_cast<juce::uint64> (count), space)) };
+            const auto offset { static_cast<size_t> (writePos % capacity) };
+            const auto firstPart { juce::jmin (chunk, static_cast<size_t> (capacity) - offset) };
+            std::memcpy (ringData + offset, bytes, firstPart);
+            std::memcpy (ringData, bytes + firstPart, chunk - firstPart);
+            ring.writePos.store (writePos + chunk, std::memory_order_release);
+            wakeReader (ring);
+            bytes += chunk;
+            count -= chunk;
+        }
+        return true;
+    };
+
+    return write (length, lengthSize) && write (static_cast<const juce::uint8*> (data), size);
+}
+
+bool SharedMemoryChannel::readIncoming ()
+{
+    auto& ring { getIncoming () };
+    const auto* ringData { getData (ring) };
+    const auto capacity { static_cast<juce::uint64> (ringSize) };
+    // copy up to `count` bytes out of the ring.
+    auto read = [&] (juce::uint8* bytes, size_t count)
+    {
+        const auto readPos { ring.readPos.load (std::memory_order_relaxed) };
+        const auto available { ring.writePos.load (std::memory_order_acquire) - readPos };
+        const auto chunk { static_cast<size_t> (juce::jmin (static_cast<juce::uint64> (count), available)) };
+        const auto offset { static_cast<size_t> (readPos % capacity) };
+        const auto firstPart { juce::jmin (chunk, static_cast<size_t> (capacity) - offset) };
+        std::memcpy (bytes, ringData + offset, firstPart);
+        std::memcpy (bytes + firstPart, ringData, chunk - firstPart);
+        ring.readPos.store (readPos + chunk, std::memory_order_release);
+        return chunk;
+    };
+
+    bool readAnything { false };
+    for (;;)
+    {
+        if (readingLength)
+        {
+            const auto chunk { read (lengthBytes + lengthRead, lengthSize - lengthRead) };
+            readAnything = readAnything || chunk > 0;
+            lengthRead += chunk;
+            if (lengthRead < lengthSize)
+                break;
+            incomingSize  = juce::ByteOrder::littleEndianInt (lengthBytes);
+            incomingRead  = 0;
+            readingLength = false;
+            lengthRead    = 0;
+        }
+
+        if (incomingRead < incomingSize)
+        {
+            // the length comes from the other process, so rather than
+            // allocating it up front, grow the message as its bytes arrive.
+            const auto waiting { ring.writePos.load (std::memory_order_acquire) -
+                                 ring.readPos.load (std::memory_order_relaxed) };
+            const auto available { static_cast<size_t> (
+                juce::jmin (static_cast<juce::uint64> (incomingSize - incomingRead), waiting)) };
+            if (incomingRead + available > incoming.getSize ())
+            {
+                const auto grown { juce::jmax (incomingRead + available, 2 * incoming.getSize ()) };
+                incoming.setSize (juce::jmin (incomingSize, grown));
+            }
+            incomingRead += read (static_cast<juce::uint8*> (incoming.getData ()) + incomingRead,
+                                  incoming.getSize () - incomingRead);
+            if (incomingRead < incomingSize)
+                break;
+        }
+
+        readingLength = true;
+        const juce::ScopedLock lock { receivedLock };
+        received.push_back (std::move (incoming));
+        incoming = {};
+    }
+    return readAnything;
+}
+
+void SharedMemoryChannel::run ()
+{
+    int idle { 0 };
+    while (!threadShouldExit ())
+    {
+        header->heartbeat[side].fetch_add (1);
+        watchPeer ();
+        auto readAnything { readIncoming () };
+        const auto connected { isConnected () };
+        const auto changed { connected != peerAttached.exchange (connected) };
+        if (!connected && changed)
+        {
+            // take whatever the other end finished sending before it went
+            // away; a partly-sent message is never going to be finished.
+            readAnything = readIncoming () || readAnything;
+            auto& ring { getIncoming () };
+            ring.readPos.store (ring.writePos.load ());
+            readingLength = true;
+            lengthRead    = 0;
+            incoming      = {};
+        }
+
+        if (readAnything || changed)
+        {
+            idle = 0;
+            if (!onMessageThread)
+                deliver ();
+            else if (!deliveryScheduled.exchange (true))
+            {
+                juce::MessageManager::callAsync (
+                    [this, stillAlive = alive] ()
+                    {
+                        if (*stillAlive)
+                            deliver ();
+                    });
+            }
+        }
+        else if (++idle < maxIdleSpins)
+            juce::Thread::yield ();
+        else
+            waitForIncoming ();
+    }
+}
+
+void SharedMemoryChannel::waitForIncoming ()
+{
+    auto& ring { getIncoming () };
+    ring.readerWaiting.store (1);
+    const auto count { ring.wakeCount.load () };
+    // look again now that the writer knows to wake us, so nothing that
+    // happened before it knew is missed.
+    if (ring.writePos.load () == ring.readPos.load (std::memory_order_relaxed) &&
+        isConnected () == peerAttached.load () && !threadShouldExit ())
+    {
+        waitForWake (ring.wakeCount, count, maxWaitMs);
+    }
+    ring.readerWaiting.store (0);
+}
+
+void SharedMemoryChannel::wakeReader (Ring& ring)
+{
+    ring.wakeCount.fetch_add (1);
+    if (ring.readerWaiting.load () != 0)
+        wakeAll (ring.wakeCount);
+}
+
+void SharedMemoryChannel::deliver ()
+{
+    // clear the flag first, so anything that arrives while we're delivering
+    // schedules another delivery.
+    deliveryScheduled = false;
+    if (header == nullptr)
+        return;
+
+    const auto connected { peerAttached.load () };
+    if (connected && !wasConnected)
+    {
+        wasConnected = true;
+        if (onConnect != nullptr)
+            onConnect ();
+    }
+
+    std::vector<juce::MemoryBlock> messages;
+    {
+        const juce::ScopedLock lock { receivedLock };
+        messages.swap (received);
+    }
+    for (const auto& message : messages)
+    {
+        if (onMessage != nullptr)
+            onMessage (message);
+        // (a callback may have closed us.)
+        if (header == nullptr)
+            return;
+    }
+
+    if (!connected && wasConnected)
+    {
+        wasConnected = false;
+        if (onDisconnect != nullptr)
+            onDisconnect ();
+    }
+}
+
+} // namespace cello
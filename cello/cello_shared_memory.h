@@ -0,0 +1,226 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <juce_core/juce_core.h>
+
+namespace cello
+{
+
+/**
+ * @class SharedMemoryChannel
+ * @brief A two-way connection between two processes on the same machine,
+ * passing messages through a block of shared memory instead of a socket or
+ * pipe.
+ *
+ * One end `create()`s the channel and the other `open()`s it by name. The
+ * shared memory is a memory-mapped file (in `/dev/shm` where that exists, so
+ * it never touches a disk) that holds a lock-free ring of bytes for each
+ * direction. A message is written into the ring as its length followed by its
+ * bytes; a message larger than the ring is written in pieces as the other end
+ * reads it, so there's no limit on message size.
+ *
+ * Each end has a thread that reads incoming messages and watches for the
+ * other end attaching or detaching. When there's nothing to read it spins
+ * briefly, then sleeps until the other end wakes it (with a futex on Linux,
+ * or `os_sync_wait_on_address` on macOS 14.4 and later; elsewhere it falls
+ * back to polling every millisecond.) As with `juce::InterprocessConnection`,
+ * the callbacks are made on the message thread unless you ask for them to be
+ * made on the reading thread instead.
+ *
+ * Each end's thread also keeps a heartbeat in the shared memory. If the other
+ * end's heartbeat stops for a couple of seconds (because its process crashed
+ * or hung without detaching), it's treated as disconnected: `onDisconnect`
+ * is called, and `sendMessage()` stops waiting for it to make room.
+ *
+ * Each direction has exactly one writer and one reader; call `sendMessage()`
+ * from only one thread at a time.
+ */
+class SharedMemoryChannel : private juce::Thread
+{
+public:
+    /**
+     * @param name identifies the channel to both processes.
+     * @param ringSize bytes in each direction's ring; both ends must agree.
+     * @param callbacksOnMessageThread false to make the callbacks on our
+     *              reading thread.
+     */
+    explicit SharedMemoryChannel (const juce::String& name, int ringSize = 1 << 20,
+                                  bool callbacksOnMessageThread = true);
+    ~SharedMemoryChannel () override;
+
+    SharedMemoryChannel (const SharedMemoryChannel&)            = delete;
+    SharedMemoryChannel& operator= (const SharedMemoryChannel&) = delete;
+
+    /**
+     * @brief Create the shared memory for the channel and attach to it.
+     *
+     * @param mustNotExist fail if another process has already created it;
+     *              otherwise, attach to the channel that process created (or
+     *              replace it, if that process has gone away or its
+     *              heartbeat has stopped.)
+     * @return true if we're attached.
+     */
+    bool create (bool mustNotExist);
+
+    /**
+     * @brief Attach to a channel that another process created.
+     *
+     * @param msTimeout how long to wait for the channel to be created; -1
+     *                  waits forever.
+     * @return true if we're attached.
+     */
+    bool open (int msTimeout = 0);
+
+    /**
+     * @brief Detach from the channel; if we created it, it's destroyed.
+     */
+    void close ();
+
+    /**
+     * @return true if we've created or opened the channel.
+     */
+    bool isAttached () const { return header != nullptr; }
+
+    /**
+     * @return true if the other end is attached too, and its heartbeat hasn't
+     * stopped.
+     */
+    bool isConnected () const;
+
+    /**
+     * @brief Send a message to the other end. If the ring is full, waits for
+     * the other end to make room.
+     *
+     * @param data
+     * @param size
+     * @return false if we're not connected, or the other end detached or its
+     *         heartbeat stopped while we were waiting.
+     */
+    bool sendMessage (const void* data, size_t size);
+
+    /// called when the other end attaches.
+    std::function<void ()> onConnect;
+    /// called when the other end detaches.
+    std::function<void ()> onDisconnect;
+    /// called with each message we receive.
+    std::function<void (const juce::MemoryBlock&)> onMessage;
+
+    /**
+     * @return the file that holds the named channel's shared memory.
+     */
+    static juce::File getSegmentFile (const juce::String& name);
+
+private:
+    struct Header;
+    struct Ring;
+
+    bool attach (bool creator);
+    void run () override;
+
+    /**
+     * @brief Wait for the other end's heartbeat to change.
+     *
+     * @return false if it didn't within `msTimeout`, or the other end isn't
+     * attached.
+     */
+    bool isPeerBeating (int msTimeout);
+
+    /**
+     * @brief (our thread) Mark the other end as stale if its heartbeat has
+     * stopped.
+     */
+    void watchPeer ();
+
+    /**
+     * @brief Copy whatever's waiting in the incoming ring into the message
+     * we're reading, moving each message that's complete to `received`.
+     *
+     * @return true if we read anything.
+     */
+    bool readIncoming ();
+
+    /**
+     * @brief Sleep until the other end sends something, attaches or detaches,
+     * or we're closed.
+     */
+    void waitForIncoming ();
+
+    /**
+     * @brief Tell the reader of `ring` there's something new to look at,
+     * waking it if it's asleep.
+     */
+    static void wakeReader (Ring& ring);
+
+    /**
+     * @brief Tell our callbacks about the other end coming and going, and
+     * pass on the messages we've received.
+     */
+    void deliver ();
+
+    /// the ring we write to, and the one we read from.
+    Ring& getOutgoing () const;
+    Ring& getIncoming () const;
+    juce::uint8* getData (const Ring& ring) const;
+
+    const juce::String channelName;
+    const int ringSize;
+    const bool onMessageThread;
+
+    std::unique_ptr<juce::MemoryMappedFile> mapping;
+    Header* header { nullptr };
+    /// 0 if we created the channel, 1 if we opened it.
+    int side { 0 };
+
+    /// the message we're reading, which may arrive in pieces.
+    juce::MemoryBlock incoming;
+    size_t incomingSize { 0 };
+    size_t incomingRead { 0 };
+    bool readingLength { true };
+    juce::uint8 lengthBytes[4] {};
+    size_t lengthRead { 0 };
+
+    /// messages that are ready to deliver.
+    std::vector<juce::MemoryBlock> received;
+    juce::CriticalSection receivedLock;
+    /// is the other end attached, as our thread last saw it, and as we last
+    /// told our callbacks?
+    std::atomic<bool> peerAttached { false };
+    bool wasConnected { false };
+
+    /// set by our thread once the other end's heartbeat has stopped.
+    std::atomic<bool> peerStale { false };
+    /// the other end's heartbeat when our thread last saw it change, and when.
+    juce::uint32 lastPeerBeat { 0 };
+    juce::uint32 lastPeerBeatMs { 0 };
+
+    /// set while a delivery is waiting to run on the message thread.
+    std::atomic<bool> deliveryScheduled { false };
+    /// shared with callbacks that are waiting to run, so they can tell if
+    /// we've been destroyed.
+    std::shared_ptr<std::atomic<bool>> alive;
+};
+
+} // namespace cello
@@ -17,62 +17,613 @@
     SOFTWARE.
 */
 
+#include <cstring>
+
 #include "cello_sync.h"
 #include "cello_object.h"
+#include "cello_path.h"
+
+namespace
+{
+/**
+ * @brief If a ValueTreeSynchroniser message sets a property, get the bytes
+ * at its start that identify the tree and the property being set.
+ *
+ * @return false if this is some other kind of change.
+ */
+bool getPropertyChangeKey (const void* update, size_t size, std::string& key)
+{
+    juce::MemoryInputStream input { update, size, false };
+    if (static_cast<juce::uint8> (input.readByte ()) !=
+        static_cast<juce::uint8> (cello::SyncChangeType::propertyChanged))
+        return false;
+
+    const auto levels { input.readCompressedInt () };
+    for (int i { 0 }; i < levels; ++i)
+        input.readCompressedInt ();
+    input.readString ();
+    if (input.isExhausted ())
+        return false;
+
+    key.assign (static_cast<const char*> (update), static_cast<size_t> (input.getPosition ()));
+    return true;
+}
+
+/**
+ * @brief If a ValueTreeSynchroniser message sets or removes a property, get the
+ * bytes that identify the tree and the property (which are the same for both.)
+ *
+ * @return false if this is some other kind of change.
+ */
+bool getPropertyKey (const void* update, size_t size, std::string& key)
+{
+    juce::MemoryInputStream input { update, size, false };
+    const auto type { static_cast<cello::SyncChangeType> (input.readByte ()) };
+    if (type != cello::SyncChangeType::propertyChanged && type != cello::SyncChangeType::propertyRemoved)
+        return false;
+
+    const auto levels { input.readCompressedInt () };
+    for (int i { 0 }; i < levels; ++i)
+        input.readCompressedInt ();
+    input.readString ();
+    const auto end { static_cast<size_t> (input.getPosition ()) };
+    if (end > size)
+        return false;
+
+    key.assign (static_cast<const char*> (update) + 1, end - 1);
+    return true;
+}
+
+// [clock][origin] after each change that a SyncGroup replica sends.
+constexpr size_t groupStampSize { sizeof (juce::uint64) + sizeof (juce::uint32) };
+
+/// tree types from the root to a tree, not including the root.
+using TypePath = std::vector<juce::Identifier>;
+
+/**
+ * @brief Convert a `Path`-style string used by a SyncFilter or SyncThrottle
+ * into the tree types that it matches.
+ */
+TypePath compileTypePath (const juce::String& path)
+{
+    TypePath pattern;
+    for (const auto& segment : cello::CompiledPath::get (path)->getSegments ())
+    {
+        if (segment.kind == cello::CompiledPath::SegmentKind::child)
+            pattern.push_back (segment.type);
+        else
+        {
+            // these paths can only look down from the producer's tree.
+            jassert (segment.kind == cello::CompiledPath::SegmentKind::root ||
+                     segment.kind == cello::CompiledPath::SegmentKind::current);
+        }
+    }
+    return pattern;
+}
+
+/**
+ * @brief Does a tree type match one segment of a path, where `*` matches any
+ * type?
+ */
+bool typeMatches (const juce::Identifier& patternType, const juce::Identifier& type)
+{
+    static const juce::Identifier wildcard { "*" };
+    return patternType == wildcard || patternType == type;
+}
+
+/**
+ * @brief Does the pattern match this tree or one of its ancestors?
+ */
+bool matchesWithin (const TypePath& pattern, const TypePath& types)
+{
+    if (pattern.size () > types.size ())
+        return false;
+    return std::equal (pattern.begin (), pattern.end (), types.begin (), typeMatches);
+}
+
+/**
+ * @brief Does the pattern match exactly this tree?
+ */
+bool matchesExactly (const TypePath& pattern, const TypePath& types)
+{
+    return pattern.size () == types.size () && matchesWithin (pattern, types);
+}
+
+/**
+ * @brief Does the pattern match a descendant of this tree?
+ */
+bool matchesBelow (const TypePath& pattern, const TypePath& types)
+{
+    if (pattern.size () <= types.size ())
+        return false;
+    return std::equal (types.begin (), types.end (), pattern.begin (),
+                       [] (const auto& type, const auto& patternType) { return typeMatches (patternType, type); });
+}
+
+/**
+ * @brief The parts of a ValueTreeSynchroniser message that SyncFilter and
+ * SyncThrottle look at.
+ */
+struct DecodedChange
+{
+    cello::SyncChangeType type;
+    /// types of the trees on the way to the one that changed.
+    TypePath types;
+    /// the property, for property changes.
+    juce::Identifier property;
+};
+
+/**
+ * @brief Decode a change to a tree; call while the tree is in the state that
+ * the change describes.
+ *
+ * @return false if this is a full sync, or a change to a tree that we can't
+ * find.
+ */
+bool decodeChange (const juce::ValueTree& root, const void* encodedChange, size_t encodedChangeSize,
+                   DecodedChange& change)
+{
+    juce::MemoryInputStream input { encodedChange, encodedChangeSize, false };
+    change.type = static_cast<cello::SyncChangeType> (input.readByte ());
+    if (change.type == cello::SyncChangeType::fullSync)
+        return false;
+
+    auto tree { root };
+    const auto levels { input.readCompressedInt () };
+    for (int i { 0 }; i < levels; ++i)
+    {
+        tree = tree.getChild (input.readCompressedInt ());
+        if (!tree.isValid ())
+            return false;
+        change.types.push_back (tree.getType ());
+    }
+
+    if (change.type == cello::SyncChangeType::propertyChanged ||
+        change.type == cello::SyncChangeType::propertyRemoved)
+        change.property = juce::Identifier { input.readString () };
+    return true;
+}
+} // namespace
 
 namespace cello
 {
 
-UpdateQueue::UpdateQueue (Object& consumer, juce::Thread* thread)
+UpdateTag::UpdateTag (const void* data_, size_t size_)
+: data (data_)
+, size (data_ != nullptr ? size_ : 0)
+{
+    if (data == nullptr)
+        return;
+
+    // find the end of the header; an echo has the same header, and a
+    // numeric or boolean value also fits in the bytes we compare after it.
+    constexpr size_t valuePrefixSize { 16 };
+    juce::MemoryInputStream input { data, size, false };
+    const auto type { static_cast<SyncChangeType> (input.readByte ()) };
+    if (type != SyncChangeType::fullSync)
+    {
+        const auto levels { input.readCompressedInt () };
+        for (int i { 0 }; i < levels && !input.isExhausted (); ++i)
+            input.readCompressedInt ();
+        if (type == SyncChangeType::propertyChanged || type == SyncChangeType::propertyRemoved)
+            input.readString ();
+        else if (type == SyncChangeType::childAdded)
+            input.readCompressedInt ();
+    }
+    compareSize = juce::jmin (size, static_cast<size_t> (input.getPosition ()) + valuePrefixSize);
+}
+
+bool UpdateTag::isEcho (const void* change, size_t changeSize)
+{
+    if (data == nullptr || changeSize != size)
+        return false;
+    if (std::memcmp (change, data, compareSize) != 0)
+        return false;
+    // the update only echoes once; anything after this is a new change.
+    clear ();
+    return true;
+}
+
+void UpdateTag::clear ()
+{
+    data        = nullptr;
+    size        = 0;
+    compareSize = 0;
+}
+
+/**
+ * @brief Publishes an instrumented UpdateQueue's statistics on the message
+ * thread.
+ *
+ * The queue may be destroyed on another thread (e.g. the worker that owns
+ * it), so the timer is stopped and detached from the queue under a lock that
+ * the callback also holds; a stopped Timer can then be deleted on any thread.
+ */
+class UpdateQueue::StatsTimer : public juce::Timer
+{
+public:
+    explicit StatsTimer (UpdateQueue& owner)
+    : queue (&owner)
+    {
+    }
+
+    void timerCallback () override
+    {
+        const juce::ScopedLock lock { mutex };
+        if (queue != nullptr)
+            queue->publishStats ();
+    }
+
+    /**
+     * @brief Stop publishing; once this returns, our queue may be deleted.
+     */
+    void detach ()
+    {
+        stopTimer ();
+        const juce::ScopedLock lock { mutex };
+        queue = nullptr;
+    }
+
+private:
+    juce::CriticalSection mutex;
+    UpdateQueue* queue;
+};
+
+UpdateQueue::UpdateQueue (Object& consumer, juce::Thread* thread, QueueOptions queueOptions)
 : dest (consumer)
 , destThread (thread)
+, options (queueOptions)
+// an AbstractFifo can hold one fewer item than its size.
+, fifo (options.lockFree ? options.capacity + 1 : 1)
 {
+    jassert (options.capacity > 0);
+    // we can't coalesce updates in the lock-free ring.
+    jassert (!(options.lockFree && options.coalesce));
+    if (options.lockFree)
+    {
+        ring.resize (static_cast<size_t> (fifo.getTotalSize ()));
+        for (auto& slot : ring)
+            slot.buffer.setSize (static_cast<size_t> (juce::jmax (0, options.bufferSize)));
+    }
+
+    if (options.instrument && options.statsInterval > 0)
+    {
+        statsTimer = std::make_unique<StatsTimer> (*this);
+        statsTimer->startTimer (options.statsInterval);
+    }
+}
+
+UpdateQueue::~UpdateQueue ()
+{
+    *alive = false;
+    if (statsTimer != nullptr)
+    {
+        statsTimer->detach ();
+        statsTimer.reset ();
+    }
 }
 
 int UpdateQueue::getPendingUpdateCount () const
 {
+    if (options.lockFree)
+        return fifo.getNumReady () + overflowCount.load ();
+
     const juce::ScopedLock lock { mutex };
     return static_cast<int> (queue.size ());
 }
 
 void UpdateQueue::performAllUpdates ()
 {
-    while (getPendingUpdateCount () > 0)
-        performNextUpdate ();
+    if (options.lockFree)
+    {
+        while (performNextRingUpdate ())
+            ;
+        return;
+    }
+
+    // take everything that's pending with a single lock, and repeat until
+    // nothing new arrived while we were applying it.
+    std::deque<QueuedUpdate> pending;
+    for (;;)
+    {
+        {
+            const juce::ScopedLock lock { mutex };
+            if (queue.empty ())
+                return;
+            pending.swap (queue);
+            poppedCount += static_cast<juce::int64> (pending.size ());
+            pendingChanges.clear ();
+        }
+        for (const auto& item : pending)
+        {
+            applyUpdate (item.update->getData (), item.update->getSize ());
+            recordApplied (item.enqueued, item.update->getSize ());
+        }
+        pending.clear ();
+    }
 }
 
 void UpdateQueue::performNextUpdate ()
 {
-    if (getPendingUpdateCount () == 0)
+    if (options.lockFree)
+    {
+        performNextRingUpdate ();
         return;
+    }
 
     // lock the queue and get the block at its head
-    juce::MemoryBlock block;
+    QueuedUpdate item;
     {
         const juce::ScopedLock lock { mutex };
-        block = std::move (queue.front ());
+        if (queue.empty ())
+            return;
+        item = std::move (queue.front ());
         queue.pop_front ();
+        ++poppedCount;
+    }
+
+    applyUpdate (item.update->getData (), item.update->getSize ());
+    recordApplied (item.enqueued, item.update->getSize ());
+}
+
+int UpdateQueue::tryPerformUpdates (int maxUpdates, double budgetMs)
+{
+    // only the lock-free ring can be read without waiting.
+    jassert (options.lockFree);
+    if (!options.lockFree)
+        return 0;
+
+    const auto start { juce::Time::getHighResolutionTicks () };
+    const auto budget { juce::Time::secondsToHighResolutionTicks (budgetMs / 1000.0) };
+    int applied { 0 };
+    while (applied < maxUpdates && fifo.getNumReady () > 0)
+    {
+        if (budgetMs > 0 && applied > 0 && juce::Time::getHighResolutionTicks () - start >= budget)
+            break;
+
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (1, start1, size1, start2, size2);
+        auto& slot { ring[static_cast<size_t> (start1)] };
+        // (applying a full sync allocates.)
+        if (slot.isFullSync)
+            break;
+        applySlot (slot);
+        recordApplied (slot.enqueued, slot.size);
+        fifo.finishedRead (1);
+        ++applied;
+    }
+    return applied;
+}
+
+bool UpdateQueue::isFullSyncPending () const
+{
+    if (!options.lockFree || fifo.getNumReady () == 0)
+        return false;
+    int start1, size1, start2, size2;
+    fifo.prepareToRead (1, start1, size1, start2, size2);
+    return ring[static_cast<size_t> (start1)].isFullSync;
+}
+
+bool UpdateQueue::performNextRingUpdate ()
+{
+    jassert (options.lockFree);
+    // anything in the ring is older than anything in the overflow queue.
+    if (fifo.getNumReady () > 0)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (1, start1, size1, start2, size2);
+        // apply the update in place, and only then hand its buffer back to
+        // the producer.
+        auto& slot { ring[static_cast<size_t> (start1)] };
+        applySlot (slot);
+        recordApplied (slot.enqueued, slot.size);
+        fifo.finishedRead (1);
+        return true;
+    }
+
+    if (overflowCount.load () > 0)
+    {
+        QueuedUpdate item;
+        {
+            const juce::ScopedLock lock { mutex };
+            item = std::move (queue.front ());
+            queue.pop_front ();
+            --overflowCount;
+        }
+        applyUpdate (item.update->getData (), item.update->getSize ());
+        recordApplied (item.enqueued, item.update->getSize ());
+        return true;
+    }
+    return false;
+}
+
+void UpdateQueue::applyUpdate (const void* data, size_t size)
+{
+    // (startUpdate() only looks at the update.)
+    startUpdate (const_cast<void*> (data), size);
+    dest.update (data, size);
+    endUpdate ();
+}
+
+void UpdateQueue::applySlot (Slot& slot)
+{
+    if (!slot.isPropertyChange)
+    {
+        applyUpdate (slot.buffer.getData (), slot.size);
+        return;
     }
 
-    startUpdate (block.getData (), block.getSize ());
-    dest.update (block);
+    startUpdate (slot.buffer.getData (), slot.size);
+    juce::ValueTree tree { dest };
+    for (const auto index : slot.path)
+        tree = tree.getChild (index);
+    // (our tree doesn't have the same structure as the producer's.)
+    jassert (tree.isValid ());
+    if (tree.isValid ())
+        tree.setProperty (slot.property, slot.value, dest.getUndoManager ());
     endUpdate ();
 }
 
+void UpdateQueue::decodePropertyChange (Slot& slot)
+{
+    slot.isPropertyChange = false;
+    juce::MemoryInputStream input { slot.buffer.getData (), slot.size, false };
+    const auto changeType { static_cast<juce::uint8> (input.readByte ()) };
+    slot.isFullSync = changeType == static_cast<juce::uint8> (SyncChangeType::fullSync);
+    if (changeType != static_cast<juce::uint8> (SyncChangeType::propertyChanged))
+        return;
+
+    const auto levels { input.readCompressedInt () };
+    if (!juce::isPositiveAndBelow (levels, 65536))
+        return;
+    slot.path.resize (static_cast<size_t> (levels));
+    for (auto& index : slot.path)
+        index = input.readCompressedInt ();
+
+    slot.property         = input.readString ();
+    slot.value            = juce::var::readFromStream (input);
+    slot.isPropertyChange = slot.property.isValid ();
+}
+
 void UpdateQueue::pushUpdate (juce::MemoryBlock&& update)
 {
+    if (options.lockFree)
+        pushUpdate (update.getData (), update.getSize ());
+    else
+        pushUpdate (std::make_shared<const juce::MemoryBlock> (std::move (update)));
+}
+
+void UpdateQueue::pushUpdate (SharedUpdate update)
+{
+    jassert (update != nullptr);
+    // the lock-free ring has its own copies of its updates.
+    if (options.lockFree)
+    {
+        pushUpdate (update->getData (), update->getSize ());
+        return;
+    }
+
     // push the update data onto the queue
     {
+        const auto enqueued { getEnqueueTime () };
+        const auto size { update->getSize () };
         const juce::ScopedLock lock { mutex };
-        queue.push_back (update);
+        // (the consumer was already notified about the update we merged with.)
+        if (options.coalesce && mergeUpdate (update))
+            return;
+        queue.push_back ({ std::move (update), enqueued });
+        ++pushedCount;
+        recordEnqueued (size, static_cast<int> (queue.size ()));
+    }
+    notifyConsumer ();
+}
+
+bool UpdateQueue::mergeUpdate (SharedUpdate& update)
+{
+    std::string key;
+    if (!getPropertyChangeKey (update->getData (), update->getSize (), key))
+    {
+        // a structural change; nothing queued before it can be merged with
+        // anything that comes after it.
+        pendingChanges.clear ();
+        return false;
+    }
+
+    const auto found { pendingChanges.find (key) };
+    if (found != pendingChanges.end () && found->second >= poppedCount)
+    {
+        // (the merged update keeps its place in the queue, and the time the
+        // first change to this property was queued.)
+        queue[static_cast<size_t> (found->second - poppedCount)].update = std::move (update);
+        ++mergedCount;
+        return true;
+    }
+
+    pendingChanges[key] = pushedCount;
+    return false;
+}
+
+void UpdateQueue::pushUpdate (const void* data, size_t size)
+{
+    if (!options.lockFree)
+    {
+        pushUpdate (juce::MemoryBlock (data, size));
+        return;
+    }
+
+    if (writeToRing (data, size))
+        notifyConsumer ();
+}
+
+bool UpdateQueue::pushFullSync (const juce::ValueTree& tree)
+{
+    // don't encode the whole tree just to drop it.
+    if (options.lockFree && (overflowCount.load () > 0 || fifo.getFreeSpace () == 0))
+        return false;
+
+    juce::MemoryOutputStream output;
+    output.writeByte (static_cast<char> (SyncChangeType::fullSync));
+    tree.writeToStream (output);
+
+    resyncNeeded = false;
+    pushUpdate (output.getData (), output.getDataSize ());
+    return true;
+}
+
+bool UpdateQueue::writeToRing (const void* data, size_t size)
+{
+    // after a gap, the consumer can't apply anything but a full sync.
+    if (resyncNeeded)
+    {
+        ++droppedCount;
+        return false;
     }
+
+    if (overflowCount.load () == 0 && fifo.getFreeSpace () > 0)
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite (1, start1, size1, start2, size2);
+        auto& slot { ring[static_cast<size_t> (start1)] };
+        if (slot.buffer.getSize () < size)
+            slot.buffer.setSize (size);
+        slot.buffer.copyFrom (data, 0, size);
+        slot.size     = size;
+        slot.enqueued = getEnqueueTime ();
+        decodePropertyChange (slot);
+        fifo.finishedWrite (1);
+        recordEnqueued (size, fifo.getNumReady () + overflowCount.load ());
+        return true;
+    }
+
+    if (options.overflow == QueueOptions::Overflow::drop)
+    {
+        ++droppedCount;
+        resyncNeeded = true;
+        return false;
+    }
+
+    // once we've overflowed, everything goes to the overflow queue until
+    // the consumer has collected it all, so updates stay in order.
+    const juce::ScopedLock lock { mutex };
+    queue.push_back ({ std::make_shared<const juce::MemoryBlock> (data, size), getEnqueueTime () });
+    ++overflowCount;
+    recordEnqueued (size, fifo.getNumReady () + overflowCount.load ());
+    return true;
+}
+
+void UpdateQueue::notifyConsumer ()
+{
     if (destThread == nullptr)
-        juce::MessageManager::callAsync (
-            [this] ()
-            {
-                jassert (juce::MessageManager::existsAndIsCurrentThread ());
-                performAllUpdates ();
-            });
+    {
+        // a drain that's already pending will pick this update up too.
+        if (!drainScheduled.exchange (true))
+            juce::MessageManager::callAsync (
+                [this, stillAlive = alive] ()
+                {
+                    if (*stillAlive)
+                        drainOnMessageThread ();
+                });
+    }
     else
         // wake the consumer thread up if it's waiting. It's the duty
         // of that thread to call either `performNextUpdate()` (iterating through
@@ -81,12 +632,275 @@ void UpdateQueue::pushUpdate (juce::MemoryBlock&& update)
         destThread->notify ();
 }
 
+void UpdateQueue::drainOnMessageThread ()
+{
+    jassert (juce::MessageManager::existsAndIsCurrentThread ());
+    const auto now { juce::Time::getMillisecondCounter () };
+    const auto interval { static_cast<juce::uint32> (juce::jmax (0, options.minDispatchInterval)) };
+    if (now - lastDrainTime < interval)
+    {
+        juce::Timer::callAfterDelay (static_cast<int> (interval - (now - lastDrainTime)),
+                                     [this, stillAlive = alive] ()
+                                     {
+                                         if (*stillAlive)
+                                             drainOnMessageThread ();
+                                     });
+        return;
+    }
+
+    lastDrainTime = now;
+    // clear the flag before draining, so an update that arrives after we've
+    // emptied the queue schedules another drain instead of being stranded.
+    drainScheduled = false;
+    performAllUpdates ();
+}
+
+juce::int64 UpdateQueue::getEnqueueTime () const
+{
+    return options.instrument ? juce::Time::getHighResolutionTicks () : 0;
+}
+
+void UpdateQueue::recordEnqueued (size_t size, int depth)
+{
+    if (!options.instrument)
+        return;
+    ++enqueuedCount;
+    enqueuedBytes += static_cast<juce::int64> (size);
+    // (only one thread at a time pushes updates.)
+    if (depth > highWaterMark.load ())
+        highWaterMark = depth;
+}
+
+void UpdateQueue::recordApplied (juce::int64 enqueueTime, size_t size)
+{
+    if (!options.instrument)
+        return;
+    ++appliedCount;
+    appliedBytes += static_cast<juce::int64> (size);
+
+    const auto latency { juce::Time::getHighResolutionTicks () - enqueueTime };
+    if (latency > maxLatency.load ())
+        maxLatency = latency;
+
+    const auto micros { juce::Time::highResolutionTicksToSeconds (latency) * 1.0e6 };
+    int bucket { 0 };
+    while (bucket < QueueStats::latencyBuckets - 1 && micros >= QueueStats::getBucketLimitMs (bucket) * 1000.0)
+        ++bucket;
+    ++latencyHistogram[static_cast<size_t> (bucket)];
+}
+
+QueueStats UpdateQueue::getStats () const
+{
+    QueueStats stats;
+    stats.enqueuedCount = enqueuedCount.load ();
+    stats.enqueuedBytes = enqueuedBytes.load ();
+    stats.appliedCount  = appliedCount.load ();
+    stats.appliedBytes  = appliedBytes.load ();
+    stats.pendingCount  = getPendingUpdateCount ();
+    stats.highWaterMark = highWaterMark.load ();
+    for (size_t i { 0 }; i < latencyHistogram.size (); ++i)
+        stats.latencyHistogram[i] = latencyHistogram[i].load ();
+    stats.maxLatencyMs = juce::Time::highResolutionTicksToSeconds (maxLatency.load ()) * 1000.0;
+    return stats;
+}
+
+UpdateQueueProperties& UpdateQueue::getQueueProperties ()
+{
+    if (queueProperties == nullptr)
+        queueProperties = std::make_unique<UpdateQueueProperties> ();
+    return *queueProperties;
+}
+
+void UpdateQueue::publishStats ()
+{
+    auto& properties { getQueueProperties () };
+    const auto stats { getStats () };
+    const auto now { juce::Time::getMillisecondCounterHiRes () };
+    const auto elapsed { (now - lastPublishTime) / 1000.0 };
+    if (lastPublishTime > 0 && elapsed > 0)
+    {
+        properties.updatesPerSecond = static_cast<double> (stats.appliedCount - lastAppliedCount) / elapsed;
+        properties.bytesPerSecond   = static_cast<double> (stats.appliedBytes - lastAppliedBytes) / elapsed;
+    }
+    lastPublishTime  = now;
+    lastAppliedCount = stats.appliedCount;
+    lastAppliedBytes = stats.appliedBytes;
+
+    properties.pendingCount    = stats.pendingCount;
+    properties.highWaterMark   = stats.highWaterMark;
+    properties.medianLatencyMs = stats.getLatencyPercentileMs (50);
+    properties.latency99Ms     = stats.getLatencyPercentileMs (99);
+    properties.maxLatencyMs    = stats.maxLatencyMs;
+
+    juce::Array<juce::var> histogram;
+    for (const auto count : stats.latencyHistogram)
+        histogram.add (count);
+    properties.latencyHistogram = juce::var { histogram };
+}
+
+double QueueStats::getBucketLimitMs (int bucket)
+{
+    return std::ldexp (1.0, bucket) / 1000.0;
+}
+
+double QueueStats::getLatencyPercentileMs (double percentile) const
+{
+    juce::int64 total { 0 };
+    for (const auto count : latencyHistogram)
+        total += count;
+    if (total == 0)
+        return 0;
+
+    const auto target { static_cast<double> (total) * juce::jlimit (0.0, 100.0, percentile) / 100.0 };
+    juce::int64 seen { 0 };
+    for (int bucket { 0 }; bucket < latencyBuckets; ++bucket)
+    {
+        seen += latencyHistogram[static_cast<size_t> (bucket)];
+        if (static_cast<double> (seen) >= target)
+            return bucket == latencyBuckets - 1 ? maxLatencyMs : getBucketLimitMs (bucket);
+    }
+    return maxLatencyMs;
+}
+
+//
+//////////////////////////////////////////////////////////////////////////
+//
+
 //
 //////////////////////////////////////////////////////////////////////////
 //
 
-Sync::Sync (Object& producer, Object& consumer, juce::Thread* thread, SyncController* controller)
-: UpdateQueue (consumer, thread)
+SyncFilter& SyncFilter::include (const juce::String& path)
+{
+    includes.push_back (compileTypePath (path));
+    return *this;
+}
+
+SyncFilter& SyncFilter::exclude (const juce::String& path)
+{
+    excludes.push_back (compileTypePath (path));
+    return *this;
+}
+
+SyncFilter& SyncFilter::allowProperties (const juce::String& path, const juce::Array<juce::Identifier>& properties)
+{
+    propertyRules.push_back ({ compileTypePath (path), properties });
+    return *this;
+}
+
+bool SyncFilter::isEmpty () const
+{
+    return includes.empty () && excludes.empty () && propertyRules.empty ();
+}
+
+bool SyncFilter::isIncluded (const TypePath& types) const
+{
+    if (includes.empty ())
+        return true;
+    return std::any_of (includes.begin (), includes.end (),
+                        [&types] (const auto& pattern) { return matchesWithin (pattern, types); });
+}
+
+bool SyncFilter::isExcluded (const TypePath& types) const
+{
+    return std::any_of (excludes.begin (), excludes.end (),
+                        [&types] (const auto& pattern) { return matchesWithin (pattern, types); });
+}
+
+bool SyncFilter::isPropertyAllowed (const TypePath& types, const juce::Identifier& property) const
+{
+    bool restricted { false };
+    for (const auto& rule : propertyRules)
+    {
+        if (!matchesExactly (rule.pattern, types))
+            continue;
+        if (rule.properties.contains (property))
+            return true;
+        restricted = true;
+    }
+    return !restricted;
+}
+
+bool SyncFilter::accepts (const juce::ValueTree& root, const void* encodedChange, size_t encodedChangeSize) const
+{
+    if (isEmpty ())
+        return true;
+
+    DecodedChange change;
+    // a full sync, or not a tree we know about; let the consumer sort it out.
+    if (!decodeChange (root, encodedChange, encodedChangeSize, change))
+        return true;
+
+    if (isExcluded (change.types))
+        return false;
+
+    switch (change.type)
+    {
+        case SyncChangeType::propertyChanged:
+        case SyncChangeType::propertyRemoved:
+            return isIncluded (change.types) && isPropertyAllowed (change.types, change.property);
+
+        case SyncChangeType::childAdded:
+        case SyncChangeType::childRemoved:
+        case SyncChangeType::childMoved:
+            // keep the children's indices in step with the producer's anywhere
+            // that an included tree may be found.
+            return isIncluded (change.types) ||
+                   std::any_of (includes.begin (), includes.end (),
+                                [&change] (const auto& pattern) { return matchesBelow (pattern, change.types); });
+
+        default:
+            return true;
+    }
+}
+
+SyncThrottle& SyncThrottle::limit (const juce::String& path, double maxUpdatesPerSecond)
+{
+    return limit (path, {}, maxUpdatesPerSecond);
+}
+
+SyncThrottle& SyncThrottle::limit (const juce::String& path, const juce::Identifier& property,
+                                   double maxUpdatesPerSecond)
+{
+    jassert (maxUpdatesPerSecond > 0);
+    rules.push_back ({ compileTypePath (path), property, 1000.0 / maxUpdatesPerSecond });
+    return *this;
+}
+
+bool SyncThrottle::isEmpty () const
+{
+    return rules.empty ();
+}
+
+double SyncThrottle::getInterval (const TypePath& types, const juce::Identifier& property) const
+{
+    double interval { 0 };
+    for (const auto& rule : rules)
+    {
+        if ((rule.property.isNull () || rule.property == property) && matchesWithin (rule.pattern, types))
+            interval = juce::jmax (interval, rule.intervalMs);
+    }
+    return interval;
+}
+
+double SyncThrottle::getShortestInterval () const
+{
+    double interval { 0 };
+    for (const auto& rule : rules)
+    {
+        if (interval == 0 || rule.intervalMs < interval)
+            interval = rule.intervalMs;
+    }
+    return interval;
+}
+
+//
+//////////////////////////////////////////////////////////////////////////
+//
+
+Sync::Sync (Object& producer, Object& consumer, juce::Thread* thread, SyncController* controller,
+            QueueOptions options)
+: UpdateQueue (consumer, thread, options)
 , juce::ValueTreeSynchroniser { producer }
 , controller (controller)
 {
@@ -94,6 +908,197 @@ Sync::Sync (Object& producer, Object& consumer, juce::Thread* thread, SyncContro
     jassert (static_cast<juce::ValueTree> (producer) != static_cast<juce::ValueTree> (consumer));
 }
 
+/**
+ * @brief Sends a throttled Sync's held changes once their interval has passed,
+ * running only while there are changes held.
+ *
+ * Like the UpdateQueue's StatsTimer, it's stopped and detached from the Sync
+ * under a lock that the callback holds, so the Sync can be destroyed on any
+ * thread.
+ */
+class Sync::ThrottleTimer : public juce::Timer
+{
+public:
+    explicit ThrottleTimer (Sync& owner)
+    : sync (&owner)
+    {
+    }
+
+    void timerCallback () override
+    {
+        const juce::ScopedLock lock { mutex };
+        if (sync == nullptr)
+            return;
+        {
+            const juce::ScopedLock throttleLock { sync->throttleLock };
+            sync->sendHeldChanges (false);
+            // (the next change that's held starts us again.)
+            if (sync->heldCount.load () == 0)
+                stopTimer ();
+        }
+        sync->publishThrottleStats ();
+    }
+
+    /**
+     * @brief Stop sending; once this returns, our Sync may be deleted.
+     */
+    void detach ()
+    {
+        stopTimer ();
+        const juce::ScopedLock lock { mutex };
+        sync = nullptr;
+    }
+
+private:
+    juce::CriticalSection mutex;
+    Sync* sync;
+};
+
+Sync::~Sync ()
+{
+    // stop the timer before anything it uses goes away.
+    if (throttleTimer != nullptr)
+    {
+        throttleTimer->detach ();
+        throttleTimer.reset ();
+    }
+}
+
+bool Sync::setThrottle (const SyncThrottle& newThrottle)
+{
+    const juce::ScopedLock lock { throttleLock };
+    // the timer would be a second producer for the lock-free ring.
+    if (!newThrottle.isEmpty () && isLockFree ())
+    {
+        jassertfalse;
+        return false;
+    }
+    sendHeldChanges (true);
+    heldChanges.clear ();
+    if (throttleTimer != nullptr)
+        throttleTimer->stopTimer ();
+
+    if (newThrottle.isEmpty ())
+    {
+        throttled = false;
+        throttle.reset ();
+        return true;
+    }
+
+    throttle  = std::make_unique<const SyncThrottle> (newThrottle);
+    throttled = true;
+    if (throttleTimer == nullptr)
+        throttleTimer = std::make_unique<ThrottleTimer> (*this);
+    return true;
+}
+
+void Sync::flushThrottledUpdates ()
+{
+    const juce::ScopedLock lock { throttleLock };
+    sendHeldChanges (true);
+}
+
+bool Sync::holdChange (const void* encodedChange, size_t encodedChangeSize)
+{
+    DecodedChange change;
+    if (!decodeChange (getRoot (), encodedChange, encodedChangeSize, change) ||
+        change.type != SyncChangeType::propertyChanged)
+    {
+        if (change.type == SyncChangeType::propertyRemoved)
+        {
+            // don't bring the property back by sending a held change later.
+            // Apart from its type, a removal's message is the key of a change
+            // to the same property.
+            std::string key { static_cast<const char*> (encodedChange), encodedChangeSize };
+            key[0] = static_cast<char> (SyncChangeType::propertyChanged);
+            const auto found { heldChanges.find (key) };
+            if (found != heldChanges.end () && found->second.isHeld)
+            {
+                found->second.isHeld = false;
+                --heldCount;
+                ++supersededCount;
+            }
+        }
+        else
+        {
+            // held changes find their trees by index, so they have to go
+            // before anything that changes the shape of the tree.
+            sendHeldChanges (true);
+        }
+        return false;
+    }
+
+    const auto interval { throttle->getInterval (change.types, change.property) };
+    if (interval <= 0)
+        return false;
+
+    std::string key;
+    if (!getPropertyChangeKey (encodedChange, encodedChangeSize, key))
+        return false;
+
+    auto& held { heldChanges[key] };
+    held.interval = interval;
+    const auto now { juce::Time::getMillisecondCounterHiRes () };
+    if (now - held.lastSent >= interval)
+    {
+        // send this one now; it replaces anything we were holding.
+        if (held.isHeld)
+        {
+            held.isHeld = false;
+            --heldCount;
+            ++supersededCount;
+        }
+        held.lastSent = now;
+        return false;
+    }
+
+    if (held.isHeld)
+        ++supersededCount;
+    else
+    {
+        held.isHeld = true;
+        ++heldCount;
+        ++deferredCount;
+        if (!throttleTimer->isTimerRunning ())
+            throttleTimer->startTimer (juce::jmax (1, juce::roundToInt (throttle->getShortestInterval ())));
+    }
+    held.change.replaceAll (encodedChange, encodedChangeSize);
+    return true;
+}
+
+void Sync::sendHeldChanges (bool all)
+{
+    if (heldCount.load () == 0)
+        return;
+
+    const auto now { juce::Time::getMillisecondCounterHiRes () };
+    for (auto& [key, held] : heldChanges)
+    {
+        if (!held.isHeld || (!all && now - held.lastSent < held.interval))
+            continue;
+        pushUpdate (held.change.getData (), held.change.getSize ());
+        held.isHeld   = false;
+        held.lastSent = now;
+        --heldCount;
+    }
+}
+
+void Sync::publishThrottleStats ()
+{
+    throttleProperties.heldCount       = heldCount.load ();
+    throttleProperties.deferredCount   = deferredCount.load ();
+    throttleProperties.supersededCount = supersededCount.load ();
+    throttleProperties.mergedCount     = getMergedUpdateCount ();
+    throttleProperties.droppedCount    = getDroppedUpdateCount ();
+}
+
+void Sync::setFilter (const SyncFilter& newFilter)
+{
+    auto replacement { newFilter.isEmpty () ? nullptr : std::make_shared<const SyncFilter> (newFilter) };
+    const juce::SpinLock::ScopedLockType lock { filterLock };
+    filter.swap (replacement);
+}
+
 void Sync::stateChanged (const void* encodedChange, size_t encodedChangeSize)
 {
     if (controller != nullptr)
@@ -102,7 +1107,40 @@ void Sync::stateChanged (const void* encodedChange, size_t encodedChangeSize)
             return;
     }
 
-    pushUpdate (juce::MemoryBlock (encodedChange, encodedChangeSize));
+    std::shared_ptr<const SyncFilter> currentFilter;
+    {
+        const juce::SpinLock::ScopedLockType lock { filterLock };
+        currentFilter = filter;
+    }
+    if (currentFilter != nullptr && !currentFilter->accepts (getRoot (), encodedChange, encodedChangeSize))
+    {
+        ++filteredCount;
+        return;
+    }
+
+    if (throttled.load ())
+    {
+        const juce::ScopedLock lock { throttleLock };
+        if (throttle != nullptr)
+        {
+            if (!holdChange (encodedChange, encodedChangeSize))
+                pushUpdate (encodedChange, encodedChangeSize);
+            return;
+        }
+    }
+
+    // if we've had to drop updates, the consumer needs our whole tree (which
+    // includes this change); until there's room for it, this change is
+    // dropped too.
+    if (!needsResync ())
+        pushUpdate (encodedChange, encodedChangeSize);
+    else if (!pushFullSync (getRoot ()))
+        countDropped ();
+}
+
+bool Sync::resync ()
+{
+    return !needsResync () || pushFullSync (getRoot ());
 }
 
 void Sync::startUpdate (void* data, size_t size)
@@ -122,19 +1160,319 @@ void Sync::endUpdate ()
 //////////////////////////////////////////////////////////////////////////
 //
 
-SyncController::SyncController (Object& obj1, juce::Thread* thread1, Object& obj2, juce::Thread* thread2)
-: sync1to2 (obj1, obj2, thread2, this)
-, sync2to1 (obj2, obj1, thread1, this)
+/**
+ * @brief The queue that feeds one of a SyncBroadcaster's consumers.
+ */
+class SyncBroadcaster::Consumer : public UpdateQueue
+{
+public:
+    Consumer (Object& consumer, juce::Thread* thread, QueueOptions options)
+    : UpdateQueue (consumer, thread, options)
+    , object (consumer)
+    {
+    }
+
+    using UpdateQueue::countDropped;
+    using UpdateQueue::pushFullSync;
+    using UpdateQueue::pushUpdate;
+
+    Object& object;
+
+private:
+    void startUpdate (void*, size_t) override {}
+    void endUpdate () override {}
+};
+
+SyncBroadcaster::SyncBroadcaster (Object& producer)
+: juce::ValueTreeSynchroniser { producer }
+{
+}
+
+SyncBroadcaster::~SyncBroadcaster () = default;
+
+UpdateQueue& SyncBroadcaster::addConsumer (Object& consumer, juce::Thread* thread, QueueOptions options)
+{
+    // cannot sync to yourself!
+    jassert (static_cast<juce::ValueTree> (consumer) != getRoot ());
+    const juce::ScopedLock lock { consumersLock };
+    consumers.push_back (std::make_unique<Consumer> (consumer, thread, options));
+    return *consumers.back ();
+}
+
+void SyncBroadcaster::removeConsumer (Object& consumer)
+{
+    const juce::ScopedLock lock { consumersLock };
+    consumers.erase (std::remove_if (consumers.begin (), consumers.end (),
+                                     [&consumer] (const auto& queue) { return &queue->object == &consumer; }),
+                     consumers.end ());
+}
+
+int SyncBroadcaster::getNumConsumers () const
+{
+    const juce::ScopedLock lock { consumersLock };
+    return static_cast<int> (consumers.size ());
+}
+
+void SyncBroadcaster::stateChanged (const void* encodedChange, size_t encodedChangeSize)
+{
+    const juce::ScopedLock lock { consumersLock };
+    if (consumers.empty ())
+        return;
+
+    const auto update { std::make_shared<const juce::MemoryBlock> (encodedChange, encodedChangeSize) };
+    for (auto& consumer : consumers)
+    {
+        if (!consumer->needsResync ())
+            consumer->pushUpdate (update);
+        else if (!consumer->pushFullSync (getRoot ()))
+            consumer->countDropped ();
+    }
+}
+
+void SyncBroadcaster::resync ()
+{
+    const juce::ScopedLock lock { consumersLock };
+    for (auto& consumer : consumers)
+    {
+        if (consumer->needsResync ())
+            consumer->pushFullSync (getRoot ());
+    }
+}
+
+//
+//////////////////////////////////////////////////////////////////////////
+//
+
+/**
+ * @brief One of the replicas in a SyncGroup: watches its Object for changes to
+ * send to the rest of the group, and queues the changes that the rest of the
+ * group sends to it.
+ *
+ * Each change is stamped with a Lamport clock and the ID of the replica that
+ * made it. A replica only applies a property change if it's later than the
+ * last change to that property that it's made or applied, so when two
+ * replicas change a property at the same time, they all end up with the same
+ * value.
+ */
+class SyncGroup::Replica : public UpdateQueue,
+                           public juce::ValueTreeSynchroniser
+{
+public:
+    Replica (SyncGroup& owner, Object& replica, juce::Thread* thread, QueueOptions options, juce::uint32 id)
+    : UpdateQueue (replica, thread, options)
+    , juce::ValueTreeSynchroniser { replica }
+    , group (owner)
+    , originId (id)
+    {
+    }
+
+    using UpdateQueue::pushUpdate;
+
+    juce::uint32 getOriginId () const { return originId; }
+
+private:
+    /// orders changes: by clock, then by the replica that made them.
+    struct Stamp
+    {
+        juce::uint64 clock { 0 };
+        juce::uint32 origin { 0 };
+
+        bool operator< (const Stamp& rhs) const
+        {
+            return clock < rhs.clock || (clock == rhs.clock && origin < rhs.origin);
+        }
+    };
+
+    void stateChanged (const void* encodedChange, size_t encodedChangeSize) override
+    {
+        // this is the change we're applying, which the rest of the group
+        // already has.
+        if (applying.isEcho (encodedChange, encodedChangeSize))
+            return;
+
+        // a change made here comes after everything we've seen.
+        const Stamp stamp { ++clock, originId };
+        recordChange (encodedChange, encodedChangeSize, stamp);
+        group.broadcast (this, stamp.clock, encodedChange, encodedChangeSize);
+    }
+
+    void applyUpdate (const void* data, size_t size) override
+    {
+        if (size < groupStampSize)
+        {
+            jassertfalse;
+            return;
+        }
+        const auto changeSize { size - groupStampSize };
+        Stamp stamp;
+        std::memcpy (&stamp.clock, static_cast<const char*> (data) + changeSize, sizeof (stamp.clock));
+        std::memcpy (&stamp.origin, static_cast<const char*> (data) + changeSize + sizeof (stamp.clock),
+                     sizeof (stamp.origin));
+        clock = juce::jmax (clock, stamp.clock);
+
+        // (a later change to the property has already been made here.)
+        if (!recordChange (data, changeSize, stamp))
+            return;
+        UpdateQueue::applyUpdate (data, changeSize);
+    }
+
+    /**
+     * @brief Keep the stamp of the latest change to each property.
+     *
+     * @return false if this is a property change that's older than the one
+     * we have.
+     */
+    bool recordChange (const void* change, size_t size, const Stamp& stamp)
+    {
+        if (!getPropertyKey (change, size, propertyKey))
+        {
+            // a structural change may move the trees that the keys point to,
+            // so structural changes are simply applied in the order they
+            // arrive.
+            lastChanges.clear ();
+            return true;
+        }
+
+        auto& last { lastChanges[propertyKey] };
+        if (stamp < last)
+            return false;
+        last = stamp;
+        return true;
+    }
+
+    void startUpdate (void* data, size_t size) override
+    {
+        applying = UpdateTag { data, size };
+    }
+
+    void endUpdate () override { applying.clear (); }
+
+    SyncGroup& group;
+    const juce::uint32 originId;
+    /// the update we're applying, if any.
+    UpdateTag applying;
+    /// our Lamport clock: the latest change that we've made or seen.
+    juce::uint64 clock { 0 };
+    /// stamp of the latest change to each property that's been changed.
+    std::unordered_map<std::string, Stamp> lastChanges;
+    /// (reused) the key of the property a change is to.
+    std::string propertyKey;
+};
+
+SyncGroup::SyncGroup (QueueOptions queueOptions)
+: options (queueOptions)
+{
+    // every other replica pushes onto each replica's queue.
+    jassert (!options.lockFree);
+}
+
+SyncGroup::~SyncGroup () = default;
+
+void SyncGroup::addReplica (Object& replica, juce::Thread* thread)
+{
+    const juce::ScopedWriteLock lock { replicasLock };
+    // each replica needs its own thread.
+    jassert (std::none_of (replicas.begin (), replicas.end (),
+                           [thread] (const auto& r) { return r->isDestinationThread (thread); }));
+    auto queueOptions { options };
+    queueOptions.lockFree = false;
+    // merging a queued change with a later arrival could keep the one with
+    // the earlier stamp.
+    queueOptions.coalesce = false;
+    replicas.push_back (std::make_unique<Replica> (*this, replica, thread, queueOptions,
+                                                   static_cast<juce::uint32> (replicas.size ())));
+}
+
+int SyncGroup::getNumReplicas () const
+{
+    const juce::ScopedReadLock lock { replicasLock };
+    return static_cast<int> (replicas.size ());
+}
+
+void SyncGroup::broadcast (Replica* origin, juce::uint64 clock, const void* encodedChange, size_t encodedChangeSize)
+{
+    const juce::ScopedReadLock lock { replicasLock };
+    if (replicas.size () < 2)
+        return;
+
+    // (the stamp goes after the change, so the queue sees an ordinary change.)
+    juce::MemoryBlock stamped { encodedChangeSize + groupStampSize };
+    stamped.copyFrom (encodedChange, 0, encodedChangeSize);
+    const auto originId { origin->getOriginId () };
+    stamped.copyFrom (&clock, static_cast<int> (encodedChangeSize), sizeof (clock));
+    stamped.copyFrom (&originId, static_cast<int> (encodedChangeSize + sizeof (clock)), sizeof (originId));
+    const auto update { std::make_shared<const juce::MemoryBlock> (std::move (stamped)) };
+    for (auto& replica : replicas)
+    {
+        if (replica.get () != origin)
+            replica->pushUpdate (update);
+    }
+}
+
+SyncGroup::Replica* SyncGroup::findReplica (juce::Thread* thread) const
+{
+    const juce::ScopedReadLock lock { replicasLock };
+    for (auto& replica : replicas)
+    {
+        if (replica->isDestinationThread (thread))
+            return replica.get ();
+    }
+    return nullptr;
+}
+
+void SyncGroup::performNextUpdate (juce::Thread* thread)
+{
+    if (auto* replica { findReplica (thread) })
+        replica->performNextUpdate ();
+    else
+        jassertfalse;
+}
+
+void SyncGroup::performAllUpdates (juce::Thread* thread)
+{
+    if (auto* replica { findReplica (thread) })
+        replica->performAllUpdates ();
+    else
+        jassertfalse;
+}
+
+int SyncGroup::getPendingUpdateCount (juce::Thread* thread) const
+{
+    if (auto* replica { findReplica (thread) })
+        return replica->getPendingUpdateCount ();
+    jassertfalse;
+    return 0;
+}
+
+//
+//////////////////////////////////////////////////////////////////////////
+//
+
+SyncController::SyncController (Object& obj1, juce::Thread* thread1, Object& obj2, juce::Thread* thread2,
+                                QueueOptions options)
+: sync1to2 (obj1, obj2, thread2, this, options)
+, sync2to1 (obj2, obj1, thread1, this, options)
 {
     jassert (thread2 != thread1);
 }
 
+void SyncController::setFilter (const SyncFilter& filter)
+{
+    setFilter (filter, filter);
+}
+
+void SyncController::setFilter (const SyncFilter& filter1to2, const SyncFilter& filter2to1)
+{
+    sync1to2.setFilter (filter1to2);
+    sync2to1.setFilter (filter2to1);
+}
+
 void SyncController::startUpdate (Sync* sync, void* data, size_t size)
 {
     if (sync == &sync1to2)
-        update1to2 = SyncData ((char*)data, size);
+        update1to2 = UpdateTag { data, size };
     else if (sync == &sync2to1)
-        update2to1 = SyncData ((char*)data, size);
+        update2to1 = UpdateTag { data, size };
     else
         jassertfalse;
 }
@@ -142,19 +1480,19 @@ void SyncController::startUpdate (Sync* sync, void* data, size_t size)
 void SyncController::endUpdate (Sync* sync)
 {
     if (sync == &sync1to2)
-        update1to2.data = {};
+        update1to2.clear ();
     else if (sync == &sync2to1)
-        update2to1.data = {};
+        update2to1.clear ();
     else
         jassertfalse;
 }
 
-bool SyncController::shouldHandleUpdate (Sync* sync, void* data, size_t size) const
+bool SyncController::shouldHandleUpdate (Sync* sync, void* data, size_t size)
 {
     if (sync == &sync1to2)
-        return update2to1 != SyncData { data, size };
+        return !update2to1.isEcho (data, size);
     else if (sync == &sync2to1)
-        return update1to2 != SyncData { data, size };
+        return !update1to2.isEcho (data, size);
     else
         jassertfalse;
     return false;
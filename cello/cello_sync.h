@@ -19,20 +19,197 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <juce_core/juce_core.h>
 #include <juce_data_structures/juce_data_structures.h>
 
+#include "cello_object.h"
+#include "cello_value.h"
+
 namespace cello
 {
 
-class Object;
+/**
+ * @brief The change types that begin each juce::ValueTreeSynchroniser message.
+ * The type is followed by the (compressed int) number of levels in the path
+ * from the root tree to the tree that changed, and the index of the child at
+ * each of those levels.
+ */
+enum class SyncChangeType : juce::uint8
+{
+    propertyChanged = 1,
+    fullSync        = 2,
+    childAdded      = 3,
+    childRemoved    = 4,
+    childMoved      = 5,
+    propertyRemoved = 6
+};
+
+/**
+ * @struct QueueOptions
+ * @brief Settings that control how an UpdateQueue passes updates from the
+ * producer thread to the consumer thread.
+ */
+struct QueueOptions
+{
+    /**
+     * Use a lock-free single producer/single consumer ring buffer instead of a
+     * deque guarded by a critical section. Only safe when exactly one thread
+     * produces updates and exactly one thread consumes them.
+     */
+    bool lockFree { false };
+
+    /**
+     * Number of updates the lock-free ring can hold. See `overflow` for what
+     * happens when the producer gets this far ahead of the consumer.
+     */
+    int capacity { 1024 };
+
+    /**
+     * Bytes preallocated for each update in the lock-free ring. The ring's
+     * buffers are reused; a buffer only grows (on the producer's thread) when
+     * an update doesn't fit in it, so the consumer never allocates or frees
+     * memory for the updates that pass through the ring.
+     */
+    int bufferSize { 256 };
+
+    /**
+     * What happens to updates that arrive while the lock-free ring is full.
+     */
+    enum class Overflow
+    {
+        /// keep them (in order) in an overflow queue until the consumer
+        /// catches up. The consumer takes a lock and frees memory to collect
+        /// these updates.
+        allocate,
+        /// discard them. The consumer side stays lock-free. Once an update
+        /// has been dropped, the consumer is out of sync, so later changes
+        /// are dropped too (cheaply) until there's room in the ring to send
+        /// the consumer the producer's entire tree (see
+        /// `UpdateQueue::needsResync()`). Applying that full sync allocates,
+        /// so `UpdateQueue::tryPerformUpdates()` leaves it for the consumer
+        /// to apply off its real-time thread (see
+        /// `UpdateQueue::isFullSyncPending()`).
+        drop
+    };
+    Overflow overflow { Overflow::allocate };
+
+    /**
+     * Merge each property change with any change to the same property of the
+     * same tree that's still waiting to be applied, so the consumer only sees
+     * the latest value. Changes to the structure of the tree are never merged
+     * or reordered, and nothing is merged across them. Only used by the locked
+     * queue, since updates can't be changed once they're in the lock-free ring.
+     */
+    bool coalesce { false };
+
+    /**
+     * When updates are applied on the message thread, the minimum time (in
+     * milliseconds) between the drains of the queue; for example, 16 to apply
+     * updates in batches at no more than 60 Hz. Whatever the interval, only one
+     * drain is scheduled at a time, and it applies every update that's waiting.
+     */
+    int minDispatchInterval { 0 };
+
+    /**
+     * Keep statistics about the updates that pass through the queue: how many
+     * updates and bytes were queued and applied, the deepest the queue has
+     * been, and a histogram of the time between queueing and applying each
+     * update (see `UpdateQueue::getStats()`).
+     */
+    bool instrument { false };
+
+    /**
+     * When instrumented, how often (in milliseconds) to publish the statistics
+     * into the queue's `UpdateQueueProperties` on the message thread; 0 to only
+     * publish them when `UpdateQueue::publishStats()` is called.
+     */
+    int statsInterval { 1000 };
+};
+
+/**
+ * @struct QueueStats
+ * @brief A snapshot of an instrumented UpdateQueue's statistics (see
+ * `QueueOptions::instrument`).
+ */
+struct QueueStats
+{
+    /// Latencies are counted in buckets whose limits double, starting at 1
+    /// microsecond; the last bucket also counts everything slower.
+    static constexpr int latencyBuckets { 24 };
+
+    juce::int64 enqueuedCount { 0 };
+    juce::int64 enqueuedBytes { 0 };
+    juce::int64 appliedCount { 0 };
+    juce::int64 appliedBytes { 0 };
+    /// updates waiting to be applied
+    int pendingCount { 0 };
+    /// the most updates that have been waiting at once
+    int highWaterMark { 0 };
+    /// number of updates applied at each latency
+    std::array<juce::int64, latencyBuckets> latencyHistogram {};
+    double maxLatencyMs { 0 };
+
+    /**
+     * @param bucket
+     * @return the (exclusive) upper limit of a latency bucket, in milliseconds.
+     */
+    static double getBucketLimitMs (int bucket);
+
+    /**
+     * @brief Estimate a percentile of the latencies from the histogram.
+     *
+     * @param percentile e.g. 50 for the median
+     * @return the upper limit of the bucket that the percentile falls in, in
+     * milliseconds.
+     */
+    double getLatencyPercentileMs (double percentile) const;
+};
+
+/**
+ * @brief The statistics of an instrumented UpdateQueue, published on the
+ * message thread so they can be watched like any other Object.
+ */
+struct UpdateQueueProperties : public Object
+{
+    UpdateQueueProperties (Object* state = nullptr)
+    : cello::Object ("UpdateQueue", state)
+    {
+    }
+    MAKE_VALUE_MEMBER (int, pendingCount, 0);
+    MAKE_VALUE_MEMBER (int, highWaterMark, 0);
+    /// updates applied per second since the last time we were published
+    MAKE_VALUE_MEMBER (double, updatesPerSecond, 0.0);
+    /// bytes of updates applied per second since the last time we were published
+    MAKE_VALUE_MEMBER (double, bytesPerSecond, 0.0);
+    MAKE_VALUE_MEMBER (double, medianLatencyMs, 0.0);
+    MAKE_VALUE_MEMBER (double, latency99Ms, 0.0);
+    MAKE_VALUE_MEMBER (double, maxLatencyMs, 0.0);
+    /// array of the counts in each of the `QueueStats` latency buckets
+    MAKE_VALUE_MEMBER (juce::var, latencyHistogram, {});
+};
 
 class UpdateQueue
 {
 public:
-    UpdateQueue (Object& consumer, juce::Thread* thread);
-    virtual ~UpdateQueue () {}
+    /// @brief An encoded update that can be shared by several queues (see
+    /// `SyncBroadcaster`); it must not be changed once it's been pushed.
+    using SharedUpdate = std::shared_ptr<const juce::MemoryBlock>;
+
+    /**
+     * @param consumer Object that the queued updates are applied to
+     * @param thread thread that applies the updates, or nullptr for the
+     *               message thread
+     * @param options see `QueueOptions`
+     */
+    UpdateQueue (Object& consumer, juce::Thread* thread, QueueOptions options = {});
+    virtual ~UpdateQueue ();
     UpdateQueue (const UpdateQueue&)            = delete;
     UpdateQueue& operator= (const UpdateQueue&) = delete;
     UpdateQueue (UpdateQueue&&)                 = delete;
@@ -44,7 +221,8 @@ public:
     int getPendingUpdateCount () const;
 
     /**
-     * @brief Execute each of the updates that are ready.
+     * @brief Execute each of the updates that are ready, including any that
+     * arrive while we're doing this.
      */
     void performAllUpdates ();
 
@@ -54,6 +232,31 @@ public:
      */
     void performNextUpdate ();
 
+    /**
+     * @brief Apply pending updates from the lock-free ring, stopping after
+     * `maxUpdates` of them or when `budgetMs` has passed, whichever comes
+     * first. This never waits on a lock, so it can be called from a real-time
+     * thread (like an audio callback).
+     *
+     * Property changes are decoded on the producer's thread as they're
+     * queued, so applying a change to an existing numeric or boolean property
+     * doesn't allocate or free memory. Other kinds of changes are applied as
+     * usual, and can allocate. Updates in the overflow queue are left for
+     * `performNextUpdate()`/`performAllUpdates()`; for real-time use, set
+     * `QueueOptions::overflow` to `Overflow::drop` so there never are any.
+     * We also stop at a full sync of the producer's tree (sent after updates
+     * were dropped), which can't be applied without allocating; see
+     * `isFullSyncPending()`.
+     *
+     * Requires `QueueOptions::lockFree`.
+     *
+     * @param maxUpdates maximum number of updates to apply
+     * @param budgetMs stop applying updates once this much time has passed;
+     *                 pass 0 for no time limit.
+     * @return number of updates applied.
+     */
+    int tryPerformUpdates (int maxUpdates, double budgetMs = 0);
+
     /**
      * @brief Check if the given thread is the destination thread for this update queue.
      * 
@@ -62,9 +265,94 @@ public:
      */
     bool isDestinationThread (juce::Thread* thread) const { return thread == destThread; }
 
+    /**
+     * @return number of updates that were discarded because the lock-free ring
+     * was full (see `QueueOptions::Overflow::drop`).
+     */
+    int getDroppedUpdateCount () const { return droppedCount.load (); }
+
+    /**
+     * @return true if an update was dropped, so the consumer won't be back in
+     * sync until the producer's entire tree has been pushed onto the queue.
+     * Until then, further updates are dropped without being queued. `Sync`
+     * and `SyncBroadcaster` push the tree with the first change that finds
+     * room in the ring (or when `Sync::resync()` is called.)
+     */
+    bool needsResync () const { return resyncNeeded.load (); }
+
+    /**
+     * @return true if the next update in the lock-free ring is a full sync
+     * of the producer's tree, which `tryPerformUpdates()` won't apply. Call
+     * `performNextUpdate()` (or `performAllUpdates()`) from somewhere on the
+     * consumer's thread that can allocate, like outside of an audio callback.
+     * (Call from the consumer's thread.)
+     */
+    bool isFullSyncPending () const;
+
+    /**
+     * @return number of updates that were merged into an update that was
+     * already queued (see `QueueOptions::coalesce`).
+     */
+    int getMergedUpdateCount () const { return mergedCount.load (); }
+
+    /**
+     * @return a snapshot of our statistics; all zero unless we're
+     * instrumented (see `QueueOptions::instrument`). Safe to call from any
+     * thread.
+     */
+    QueueStats getStats () const;
+
+    /**
+     * @brief Copy our statistics into `getQueueProperties()`. When
+     * `QueueOptions::statsInterval` is set, this is called periodically on
+     * the message thread.
+     */
+    void publishStats ();
+
+    /**
+     * @brief Our statistics, as of the last call to `publishStats()`. The
+     * Object is created the first time it's needed, so a queue that isn't
+     * instrumented doesn't have one; call on the message thread.
+     */
+    UpdateQueueProperties& getQueueProperties ();
+
 protected:
+    /**
+     * @return true if we're using the lock-free ring (see `QueueOptions::lockFree`).
+     */
+    bool isLockFree () const { return options.lockFree; }
+
     void pushUpdate (juce::MemoryBlock&& update);
 
+    /**
+     * @brief Push a copy of an update onto the queue. When we're lock-free, the
+     * update is copied into one of the ring's preallocated buffers.
+     */
+    void pushUpdate (const void* data, size_t size);
+
+    /**
+     * @brief Push an update that may also be in other queues onto the queue.
+     * The locked queue keeps a reference to the update instead of copying it.
+     */
+    void pushUpdate (SharedUpdate update);
+
+    /**
+     * @brief Push an update that replaces the consumer's entire tree with a
+     * copy of the producer's, to bring it back in sync after dropping
+     * updates. (Call from the producer's thread.)
+     *
+     * @param tree the producer's tree
+     * @return false (without encoding the tree) if there's no room for it in
+     *         the lock-free ring; we still need a resync.
+     */
+    bool pushFullSync (const juce::ValueTree& tree);
+
+    /**
+     * @brief Count an update that the producer dropped without pushing it
+     * (see `getDroppedUpdateCount()`).
+     */
+    void countDropped () { ++droppedCount; }
+
     /**
      * @brief Called when a new update is pushed onto the queue. We use this 
      * to prevent feedback loops.
@@ -78,32 +366,230 @@ protected:
      */
     virtual void endUpdate () = 0;
 
+    /**
+     * @brief Apply an update to the destination Object, between calls to
+     * `startUpdate()` and `endUpdate()`. Override this to apply updates that
+     * use a format of your own (as long as they aren't queued lock-free.)
+     */
+    virtual void applyUpdate (const void* data, size_t size);
+
 private:
+    /**
+     * @brief Copy an update into the lock-free ring, or handle it according
+     * to our overflow policy if there's no room.
+     *
+     * @return false if the update was dropped.
+     */
+    bool writeToRing (const void* data, size_t size);
+
+    /**
+     * @brief Apply the oldest update in the lock-free ring (or its overflow
+     * queue).
+     *
+     * @return false if there were no updates pending.
+     */
+    bool performNextRingUpdate ();
+
+    /**
+     * @brief If an update changes a property that a queued update also
+     * changes, replace the queued update with it. Call with the lock held.
+     *
+     * @return true if the update was merged.
+     */
+    bool mergeUpdate (SharedUpdate& update);
+
+    struct Slot;
+
+    /**
+     * @brief Apply the update that's in a slot of the lock-free ring.
+     */
+    void applySlot (Slot& slot);
+
+    /**
+     * @brief If the update in a slot is a property change, decode it so the
+     * consumer can apply it directly.
+     */
+    static void decodePropertyChange (Slot& slot);
+
+    /**
+     * @brief Let the consumer side know that there's something to apply.
+     */
+    void notifyConsumer ();
+
+    /**
+     * @brief Apply everything in the queue on the message thread, unless
+     * that's sooner than `QueueOptions::minDispatchInterval` after we last did
+     * this, in which case we come back later.
+     */
+    void drainOnMessageThread ();
+
+    /**
+     * @return the time to record for an update that's being queued now, if
+     * we're instrumented.
+     */
+    juce::int64 getEnqueueTime () const;
+
+    /**
+     * @brief Count an update that's been queued, and note how deep the queue
+     * is now.
+     */
+    void recordEnqueued (size_t size, int depth);
+
+    /**
+     * @brief Count an update that's been applied, and how long it waited.
+     */
+    void recordApplied (juce::int64 enqueueTime, size_t size);
+
+    /// @brief an update in the locked (or overflow) queue.
+    struct QueuedUpdate
+    {
+        SharedUpdate update;
+        /// high-resolution tick count when it was queued, if we're instrumented.
+        juce::int64 enqueued { 0 };
+    };
+
+    /// @brief one of the buffers in the lock-free ring.
+    struct Slot
+    {
+        juce::MemoryBlock buffer;
+        size_t size { 0 };
+        /// high-resolution tick count when it was queued, if we're instrumented.
+        juce::int64 enqueued { 0 };
+
+        /// the update is a full sync of the producer's tree.
+        bool isFullSync { false };
+        /// the update is a property change, decoded into the members below.
+        bool isPropertyChange { false };
+        /// index of the child at each level from the root to the changed tree
+        std::vector<int> path;
+        juce::Identifier property;
+        juce::var value;
+    };
+
     /// @brief  Cello object that is being updated
     Object& dest;
     /// @brief juce Thread object responsible for performing destination updates
     juce::Thread* destThread;
+    /// @brief how we queue updates
+    const QueueOptions options;
     /// @brief Critical section to maintain thread sanity
     juce::CriticalSection mutex;
-    /// @brief Queue of tree updates to communicate between threads
-    std::deque<juce::MemoryBlock> queue;
+    /// @brief Queue of tree updates to communicate between threads. When
+    /// we're lock-free, this only holds updates that didn't fit in the ring.
+    std::deque<QueuedUpdate> queue;
+    /// @brief number of updates in `queue` when we're lock-free, so the
+    /// consumer only needs the lock when there's overflow to collect.
+    std::atomic<int> overflowCount { 0 };
+    /// @brief set while a drain on the message thread is pending.
+    std::atomic<bool> drainScheduled { false };
+    /// @brief shared with drains that are waiting to run on the message
+    /// thread, so they can tell if we've been destroyed.
+    std::shared_ptr<std::atomic<bool>> alive { std::make_shared<std::atomic<bool>> (true) };
+    /// @brief when we last drained the queue on the message thread
+    juce::uint32 lastDrainTime { 0 };
+    /// @brief number of updates discarded by the `drop` overflow policy
+    std::atomic<int> droppedCount { 0 };
+    /// @brief we dropped an update; everything is dropped until we can push
+    /// a full sync.
+    std::atomic<bool> resyncNeeded { false };
+    /// @brief number of updates merged into updates that were already queued
+    std::atomic<int> mergedCount { 0 };
+    /// @brief when coalescing, the total number of updates pushed onto and
+    /// popped from `queue`, so we can find a queued update by its position.
+    juce::int64 pushedCount { 0 };
+    juce::int64 poppedCount { 0 };
+    /// @brief position of the most recent queued change to each property,
+    /// keyed by the bytes that identify the tree and property.
+    std::unordered_map<std::string, juce::int64> pendingChanges;
+    /// @brief manages the read and write positions in `ring`
+    juce::AbstractFifo fifo;
+    /// @brief storage for the lock-free ring of updates
+    std::vector<Slot> ring;
+
+    /// @brief statistics, when we're instrumented.
+    std::atomic<juce::int64> enqueuedCount { 0 };
+    std::atomic<juce::int64> enqueuedBytes { 0 };
+    std::atomic<juce::int64> appliedCount { 0 };
+    std::atomic<juce::int64> appliedBytes { 0 };
+    std::atomic<int> highWaterMark { 0 };
+    std::atomic<juce::int64> maxLatency { 0 };
+    std::array<std::atomic<juce::int64>, QueueStats::latencyBuckets> latencyHistogram {};
+    /// @brief when we last published our statistics, and what they were then,
+    /// so we can calculate rates.
+    double lastPublishTime { 0 };
+    juce::int64 lastAppliedCount { 0 };
+    juce::int64 lastAppliedBytes { 0 };
+    std::unique_ptr<UpdateQueueProperties> queueProperties;
+
+    class StatsTimer;
+    std::unique_ptr<StatsTimer> statsTimer;
 };
 
 class SyncController;
 
 /**
- * @class Sync
- * @brief Permits thread-safe Object updates by using the
- * juce::ValueTreeSynchroniser class to generate small binary patches that
- * are used to pass updates from one copy of a ValueTree to another, each in
- * separate threads. This sync is only performed in one direction, so you will
- * need a pair of these objects to perform bidirectional syncs.
+ * @class UpdateTag
+ * @brief Identifies the encoded update that's currently being applied, so that
+ * the change it causes can be recognized as an echo (and not sent back where
+ * it came from.)
  *
- * Take care to not generate infinite update loops.
+ * Tagging an update keeps a pointer to it, which must stay valid until the
+ * tag is cleared, and finds where its header (the change type, the path to the
+ * tree that changed and the property name or child index) ends. An outgoing
+ * change is the echo if it's the same size, with the same header and the same
+ * first few bytes of value, so recognizing an echo costs the same however
+ * large the value is. A tag matches at most once, so any secondary changes
+ * made while the update is applied (e.g. by a listener) are still sent.
+ *
+ * (A secondary change to the same property that's made while the update is
+ * applied, and that's the same size, may be taken as the echo instead; since
+ * ValueTreeSynchroniser sends a property's current value, whichever of the
+ * two is sent carries the value that the tree ends up with.)
  */
+class UpdateTag
+{
+public:
+    UpdateTag () = default;
+
+    /**
+     * @brief Tag the update that's about to be applied.
+     *
+     * @param data the update, which must outlive the tag.
+     * @param size
+     */
+    UpdateTag (const void* data, size_t size);
+
+    /**
+     * @brief Test whether an outgoing change is the echo of the tagged update;
+     * if so, the tag is cleared.
+     *
+     * @param change
+     * @param changeSize
+     * @return true if this change should not be sent.
+     */
+    bool isEcho (const void* change, size_t changeSize);
+
+    /**
+     * @brief Forget the tagged update.
+     */
+    void clear ();
+
+    /**
+     * @return true if we're tagging an update.
+     */
+    bool isSet () const { return data != nullptr; }
+
+private:
+    const void* data { nullptr };
+    size_t size { 0 };
+    /// how many bytes at the start of a change are compared.
+    size_t compareSize { 0 };
+};
+
 /**
  * @struct SyncData
- * @brief Data structure for holding synchronization update information
+ * @brief Data structure for holding synchronization update information.
+ * Retained for compatibility; the sync classes now use UpdateTag.
  */
 struct SyncData
 {
@@ -120,6 +606,10 @@ struct SyncData
     {
         if (size != other.size)
             return false;
+        if (data == other.data || size == 0)
+            return true;
+        if (data == nullptr || other.data == nullptr)
+            return false;
         for (size_t i { 0 }; i < size; ++i)
             if (data[i] != other.data[i])
                 return false;
@@ -128,6 +618,199 @@ struct SyncData
     bool operator!= (const SyncData& other) const { return !(*this == other); }
 };
 
+/**
+ * @class SyncFilter
+ * @brief Selects which of a producer's changes a `Sync` passes to its
+ * consumer. Changes that the filter rejects are dropped on the producer's
+ * side, before they're queued.
+ *
+ * Filters are written as `Path`-style strings of tree types relative to the
+ * producer's tree, e.g. `"transport"` or `"mixer/channel"`. A segment that's
+ * a `*` matches a tree of any type. A filter with no rules accepts everything.
+ *
+ * - `include()`: only changes in the trees that match (and their descendants)
+ *   are passed. If there are no includes, everything is included.
+ * - `exclude()`: changes in the trees that match (and their descendants) are
+ *   dropped, even if they're also included.
+ * - `allowProperties()`: only changes to the listed properties of the trees
+ *   that match are passed.
+ *
+ * Because child trees are found by their index, children are added, removed
+ * and moved in a tree that's included or that's an ancestor of an included
+ * tree, so that the consumer's indices still match the producer's. A full
+ * sync (see `UpdateQueue::pushFullSync()`) is always passed.
+ */
+class SyncFilter
+{
+public:
+    /**
+     * @brief Only pass changes made within trees matching this path.
+     *
+     * @param path
+     * @return SyncFilter& this filter, so calls can be chained.
+     */
+    SyncFilter& include (const juce::String& path);
+
+    /**
+     * @brief Never pass changes made within trees matching this path.
+     *
+     * @param path
+     * @return SyncFilter& this filter, so calls can be chained.
+     */
+    SyncFilter& exclude (const juce::String& path);
+
+    /**
+     * @brief In trees matching this path, only pass changes to these
+     * properties. If more than one allow-list matches a tree, a property on any
+     * of them is passed.
+     *
+     * @param path
+     * @param properties
+     * @return SyncFilter& this filter, so calls can be chained.
+     */
+    SyncFilter& allowProperties (const juce::String& path, const juce::Array<juce::Identifier>& properties);
+
+    /**
+     * @return true if this filter has no rules, and accepts every change.
+     */
+    bool isEmpty () const;
+
+    /**
+     * @brief Test whether an encoded change to a tree should be passed on.
+     * Must be called while the tree is in the state that the change describes
+     * (i.e. from `ValueTreeSynchroniser::stateChanged()`).
+     *
+     * @param root the producer's tree
+     * @param encodedChange a `juce::ValueTreeSynchroniser` message
+     * @param encodedChangeSize
+     * @return true if the change should be passed to the consumer.
+     */
+    bool accepts (const juce::ValueTree& root, const void* encodedChange, size_t encodedChangeSize) const;
+
+private:
+    /// tree types from the root to a tree, not including the root.
+    using TypePath = std::vector<juce::Identifier>;
+
+    bool isIncluded (const TypePath& types) const;
+    bool isExcluded (const TypePath& types) const;
+    bool isPropertyAllowed (const TypePath& types, const juce::Identifier& property) const;
+
+    struct PropertyRule
+    {
+        TypePath pattern;
+        juce::Array<juce::Identifier> properties;
+    };
+
+    std::vector<TypePath> includes;
+    std::vector<TypePath> excludes;
+    std::vector<PropertyRule> propertyRules;
+};
+
+/**
+ * @class SyncThrottle
+ * @brief Limits how often a `Sync` passes changes to some properties to its
+ * consumer, so that values that change very quickly (meters, playhead
+ * positions) don't flood the consumer's queue.
+ *
+ * A change that arrives too soon after the last change to the same property of
+ * the same tree is held back; if another change to it arrives first, it
+ * replaces the one being held (last value wins). Held changes are sent when
+ * their interval has passed, so the consumer always ends up with the final
+ * value.
+ *
+ * Paths are written as for `SyncFilter`, and a rule applies to the trees that
+ * match its path and their descendants. If more than one rule applies to a
+ * property, the slowest rate is used.
+ */
+class SyncThrottle
+{
+public:
+    /**
+     * @brief Limit the rate of changes to every property in trees matching
+     * this path.
+     *
+     * @param path
+     * @param maxUpdatesPerSecond
+     * @return SyncThrottle& this throttle, so calls can be chained.
+     */
+    SyncThrottle& limit (const juce::String& path, double maxUpdatesPerSecond);
+
+    /**
+     * @brief Limit the rate of changes to one property in trees matching this
+     * path.
+     *
+     * @param path
+     * @param property
+     * @param maxUpdatesPerSecond
+     * @return SyncThrottle& this throttle, so calls can be chained.
+     */
+    SyncThrottle& limit (const juce::String& path, const juce::Identifier& property, double maxUpdatesPerSecond);
+
+    /**
+     * @return true if this throttle has no rules.
+     */
+    bool isEmpty () const;
+
+private:
+    friend class Sync;
+
+    /// tree types from the root to a tree, not including the root.
+    using TypePath = std::vector<juce::Identifier>;
+
+    /**
+     * @return the minimum time in milliseconds between changes to this
+     * property of a tree, or 0 if it isn't throttled.
+     */
+    double getInterval (const TypePath& types, const juce::Identifier& property) const;
+
+    /**
+     * @return the shortest interval of any of our rules, in milliseconds.
+     */
+    double getShortestInterval () const;
+
+    struct Rule
+    {
+        TypePath pattern;
+        /// null to match every property.
+        juce::Identifier property;
+        double intervalMs;
+    };
+
+    std::vector<Rule> rules;
+};
+
+/**
+ * @brief Statistics about a throttled `Sync`, published on the message thread
+ * so they can be watched like any other Object.
+ */
+struct SyncThrottleProperties : public Object
+{
+    SyncThrottleProperties (Object* state = nullptr)
+    : cello::Object ("SyncThrottle", state)
+    {
+    }
+    /// number of changes currently held back
+    MAKE_VALUE_MEMBER (int, heldCount, 0);
+    /// number of changes that were held back instead of being sent right away
+    MAKE_VALUE_MEMBER (int, deferredCount, 0);
+    /// number of held changes that were replaced by a later value
+    MAKE_VALUE_MEMBER (int, supersededCount, 0);
+    /// see `UpdateQueue::getMergedUpdateCount()`
+    MAKE_VALUE_MEMBER (int, mergedCount, 0);
+    /// see `UpdateQueue::getDroppedUpdateCount()`
+    MAKE_VALUE_MEMBER (int, droppedCount, 0);
+};
+
+/**
+ * @class Sync
+ * @brief Permits thread-safe Object updates by using the
+ * juce::ValueTreeSynchroniser class to generate small binary patches that
+ * are used to pass updates from one copy of a ValueTree to another, each in
+ * separate threads. This sync is only performed in one direction, so you will
+ * need a pair of these objects to perform bidirectional syncs.
+ *
+ * Take care to not generate infinite update loops.
+ */
 class Sync : public UpdateQueue,
              public juce::ValueTreeSynchroniser
 {
@@ -142,12 +825,75 @@ public:
      *              message thread, pass a nullptr for this arg.
      * @param controller pointer to the (optional) SyncController that will be 
      *                   used when we are performing a bidirectional sync.
+     * @param options how updates are queued between the threads; see `QueueOptions`
      */
-    Sync (Object& producer, Object& consumer, juce::Thread* thread, SyncController* controller = nullptr);
+    Sync (Object& producer, Object& consumer, juce::Thread* thread, SyncController* controller = nullptr,
+          QueueOptions options = {});
 
     Sync (const Sync&)            = delete;
     Sync& operator= (const Sync&) = delete;
 
+    /**
+     * @brief Only pass the changes that this filter accepts to the consumer.
+     * Pass an empty filter to send every change. Safe to call from any
+     * thread.
+     *
+     * @param newFilter
+     */
+    void setFilter (const SyncFilter& newFilter);
+
+    /**
+     * @return the number of changes that our filter has rejected.
+     */
+    int getFilteredUpdateCount () const { return filteredCount.load (); }
+
+    /**
+     * @brief Limit how often changes to some properties are passed to the
+     * consumer; see `SyncThrottle`. Held changes are sent from a timer on the
+     * message thread, which only runs while changes are held, so a throttled
+     * Sync can't use `QueueOptions::lockFree` (its queue would have two
+     * producers). Pass an empty throttle to send every change right away.
+     *
+     * @param newThrottle
+     * @return false (and the Sync isn't throttled) if this Sync is lock-free.
+     */
+    bool setThrottle (const SyncThrottle& newThrottle);
+
+    /**
+     * @brief Send every change that's being held back by our throttle now.
+     * Safe to call from any thread.
+     */
+    void flushThrottledUpdates ();
+
+    /**
+     * @brief If updates have been dropped (see `needsResync()`), push our
+     * entire tree to the consumer now, instead of waiting for the next
+     * change. Call from the producer's thread.
+     *
+     * @return false if there's still no room for it in the queue.
+     */
+    bool resync ();
+
+    /**
+     * @return number of changes that were held back by our throttle instead of
+     * being sent right away.
+     */
+    int getDeferredUpdateCount () const { return deferredCount.load (); }
+
+    /**
+     * @return number of held changes that were replaced by a later value
+     * before they were sent.
+     */
+    int getSupersededUpdateCount () const { return supersededCount.load (); }
+
+    /**
+     * @brief Statistics about our throttle, updated on the message thread
+     * while changes are being held.
+     */
+    SyncThrottleProperties& getThrottleProperties () { return throttleProperties; }
+
+    ~Sync () override;
+
 private:
     /**
      * @brief Whenever the state of the producer tree changes, this callback will
@@ -165,6 +911,212 @@ private:
     void endUpdate () override;
 
     SyncController* controller { nullptr };
+
+    /// swapped in by setFilter(); null if we pass every change.
+    std::shared_ptr<const SyncFilter> filter;
+    juce::SpinLock filterLock;
+    std::atomic<int> filteredCount { 0 };
+
+    /**
+     * @brief If our throttle applies to a change, hold it back or send it as
+     * needed. Call with `throttleLock` held.
+     *
+     * @return true if the change is being held.
+     */
+    bool holdChange (const void* encodedChange, size_t encodedChangeSize);
+
+    /**
+     * @brief Send the held changes, or only the ones whose interval has passed.
+     * Call with `throttleLock` held.
+     */
+    void sendHeldChanges (bool all);
+
+    /**
+     * @brief Copy our throttle statistics into `throttleProperties`.
+     */
+    void publishThrottleStats ();
+
+    /// @brief the latest change to one property of one tree while throttled.
+    struct HeldChange
+    {
+        /// when we last sent a change to this property
+        double lastSent { 0 };
+        /// minimum time between changes, in milliseconds
+        double interval { 0 };
+        /// the change we're holding back, if `isHeld`.
+        juce::MemoryBlock change;
+        bool isHeld { false };
+    };
+
+    std::unique_ptr<const SyncThrottle> throttle;
+    std::atomic<bool> throttled { false };
+    /// guards the throttle and the held changes.
+    juce::CriticalSection throttleLock;
+    /// keyed by the bytes that identify the tree and property.
+    std::unordered_map<std::string, HeldChange> heldChanges;
+    std::atomic<int> heldCount { 0 };
+    std::atomic<int> deferredCount { 0 };
+    std::atomic<int> supersededCount { 0 };
+    SyncThrottleProperties throttleProperties;
+
+    class ThrottleTimer;
+    std::unique_ptr<ThrottleTimer> throttleTimer;
+};
+
+/**
+ * @class SyncBroadcaster
+ * @brief Keeps any number of consumer Objects in sync with a single producer
+ * Object. Each change to the producer is encoded once into an immutable
+ * buffer that's shared by the queues of all of the consumers, instead of
+ * each consumer needing its own `Sync` that encodes and copies every change
+ * again.
+ *
+ * As with `Sync`, each consumer is updated on its own thread (or the message
+ * thread), and that thread is responsible for calling `performAllUpdates()`
+ * (or `performNextUpdate()`) on the queue returned by `addConsumer()`.
+ */
+class SyncBroadcaster : public juce::ValueTreeSynchroniser
+{
+public:
+    /**
+     * @param producer cello::Object that will be sending updates
+     */
+    explicit SyncBroadcaster (Object& producer);
+    ~SyncBroadcaster () override;
+
+    SyncBroadcaster (const SyncBroadcaster&)            = delete;
+    SyncBroadcaster& operator= (const SyncBroadcaster&) = delete;
+
+    /**
+     * @brief Start sending updates to another Object.
+     *
+     * @param consumer cello::Object that will be kept in sync with the producer
+     * @param thread non-owning pointer to the Thread on which the consumer will
+     *              be updated, or nullptr for the message thread.
+     * @param options how updates are queued for this consumer; see `QueueOptions`
+     * @return the consumer's queue, which remains valid until the consumer is
+     * removed or the broadcaster is destroyed.
+     */
+    UpdateQueue& addConsumer (Object& consumer, juce::Thread* thread, QueueOptions options = {});
+
+    /**
+     * @brief Stop sending updates to an Object. Its queue is destroyed, so
+     * this must not be called while the consumer's thread might be using it.
+     *
+     * @param consumer
+     */
+    void removeConsumer (Object& consumer);
+
+    /**
+     * @return number of consumers we're updating.
+     */
+    int getNumConsumers () const;
+
+    /**
+     * @brief Push our entire tree to each consumer that needs a resync
+     * (see `UpdateQueue::needsResync()`) instead of waiting for the next
+     * change. Call from the producer's thread.
+     */
+    void resync ();
+
+private:
+    void stateChanged (const void* encodedChange, size_t encodedChangeSize) override;
+
+    class Consumer;
+    /// @brief guards the list of consumers against changes while we're sending.
+    juce::CriticalSection consumersLock;
+    std::vector<std::unique_ptr<Consumer>> consumers;
+};
+
+/**
+ * @class SyncGroup
+ * @brief Keeps any number of replicas of an Object, each in its own thread,
+ * in sync with each other. A change made to any of the replicas is encoded
+ * once and queued for each of the others (never for the replica that it came
+ * from). When a replica applies an update, the changes that the update
+ * itself causes aren't sent anywhere, but any other changes made in
+ * response to it (by callbacks, etc.) are sent to all of the other replicas.
+ *
+ * When two replicas change the same property at the same time, each of the
+ * others applies whichever of the changes is later (by a Lamport clock, with
+ * ties broken by the order the replicas were added in), and ignores the
+ * other, so all of the replicas end up with the same value. Structural
+ * changes (adding, removing or moving children) are applied in the order
+ * they arrive.
+ *
+ * Each replica's thread is responsible for calling `performAllUpdates()` (or
+ * `performNextUpdate()`) with itself as the argument. Since a replica's queue
+ * is fed by all of the other replicas, lock-free queues can't be used, and
+ * queued changes aren't coalesced.
+ */
+class SyncGroup
+{
+public:
+    /**
+     * @param options how updates are queued for each replica; see `QueueOptions`
+     */
+    explicit SyncGroup (QueueOptions options = {});
+    ~SyncGroup ();
+
+    SyncGroup (const SyncGroup&)            = delete;
+    SyncGroup& operator= (const SyncGroup&) = delete;
+
+    /**
+     * @brief Add a replica to the group. The replica isn't brought up to date
+     * with the others, so it should have the same contents as they do when
+     * it's added.
+     *
+     * @param replica Object to keep in sync with the rest of the group
+     * @param thread non-owning pointer to the Thread on which the replica is
+     *               updated, or nullptr for the message thread. Each replica
+     *               must be updated on a different thread.
+     */
+    void addReplica (Object& replica, juce::Thread* thread);
+
+    /**
+     * @return number of replicas in the group.
+     */
+    int getNumReplicas () const;
+
+    /**
+     * @brief Perform the next update for the replica on the given thread.
+     */
+    void performNextUpdate (juce::Thread* thread);
+
+    /**
+     * @brief Perform all updates for the replica on the given thread.
+     */
+    void performAllUpdates (juce::Thread* thread);
+
+    /**
+     * @return number of updates waiting to be applied to the replica on the
+     * given thread.
+     */
+    int getPendingUpdateCount (juce::Thread* thread) const;
+
+private:
+    class Replica;
+
+    /**
+     * @brief Queue a change made to one replica for all of the others.
+     *
+     * @param origin the replica the change was made to
+     * @param clock its Lamport clock when it made the change
+     * @param encodedChange
+     * @param encodedChangeSize
+     */
+    void broadcast (Replica* origin, juce::uint64 clock, const void* encodedChange, size_t encodedChangeSize);
+
+    /**
+     * @return the replica that's updated on a thread, or nullptr.
+     */
+    Replica* findReplica (juce::Thread* thread) const;
+
+    const QueueOptions options;
+    /// @brief lets replicas broadcast at the same time, but not while a
+    /// replica is being added.
+    juce::ReadWriteLock replicasLock;
+    std::vector<std::unique_ptr<Replica>> replicas;
 };
 
 /**
@@ -182,8 +1134,10 @@ public:
      * @param threadForObj1 pointer to the thread for the first Object
      * @param obj2 pointer to the second Object
      * @param threadForObj2 pointer to the thread for the second Object
+     * @param options how updates are queued in each direction; see `QueueOptions`
      */
-    SyncController (Object& obj1, juce::Thread* threadForObj1, Object& obj2, juce::Thread* threadForObj2);
+    SyncController (Object& obj1, juce::Thread* threadForObj1, Object& obj2, juce::Thread* threadForObj2,
+                    QueueOptions options = {});
     ~SyncController () = default;
 
     SyncController (const SyncController&)            = delete;
@@ -203,12 +1157,27 @@ public:
      */
     void performAllUpdates (juce::Thread* thread);
 
+    /**
+     * @brief Filter the changes sent in both directions; see `SyncFilter`.
+     *
+     * @param filter
+     */
+    void setFilter (const SyncFilter& filter);
+
+    /**
+     * @brief Filter the changes sent in each direction separately.
+     *
+     * @param filter1to2 changes from the first Object to the second
+     * @param filter2to1 changes from the second Object to the first
+     */
+    void setFilter (const SyncFilter& filter1to2, const SyncFilter& filter2to1);
+
 private:
     Sync sync1to2;
     Sync sync2to1; 
 
-    SyncData update1to2;
-    SyncData update2to1;
+    UpdateTag update1to2;
+    UpdateTag update2to1;
 
     friend class Sync;
     /**
@@ -234,7 +1203,7 @@ private:
      * @param data pointer to the update data
      * @param size size of the update data
      */
-    bool shouldHandleUpdate (Sync* sync, void* data, size_t size) const;
+    bool shouldHandleUpdate (Sync* sync, void* data, size_t size);
 
 };
 
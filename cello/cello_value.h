@@ -259,7 +259,12 @@ private:
             auto* excluded = (excludedListener != nullptr) ? excludedListener : object.getExcludedListener ();
             const auto asVar { juce::VariantConverter<T>::toVar (val) };
             if (excluded)
+            {
+                // Objects receive their callbacks through a Dispatcher, which
+                // needs to be told about the exclusion separately.
+                const Dispatcher::ScopedExclusion exclusion { excluded };
                 tree.setPropertyExcludingListener (excluded, id, asVar, object.getUndoManager ());
+            }
             else
                 tree.setProperty (id, asVar, object.getUndoManager ());
         }
@@ -0,0 +1,239 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <juce_core/juce_core.h>
+
+#include "../cello_diff.h"
+#include "../cello_object.h"
+
+namespace
+{
+juce::ValueTree makeRow (int id, int value)
+{
+    juce::ValueTree row { "row" };
+    row.setProperty ("id", id, nullptr);
+    row.setProperty ("value", value, nullptr);
+    return row;
+}
+
+juce::ValueTree makeTable (int rowCount)
+{
+    juce::ValueTree table { "table" };
+    for (int i { 0 }; i < rowCount; ++i)
+        table.appendChild (makeRow (i, i * 10), nullptr);
+    return table;
+}
+
+/**
+ * @brief like `ValueTree::isEquivalentTo()`, but ignores the order of
+ * properties.
+ */
+bool hasSameContent (const juce::ValueTree& lhs, const juce::ValueTree& rhs)
+{
+    if (lhs.getType () != rhs.getType () || lhs.getNumProperties () != rhs.getNumProperties () ||
+        lhs.getNumChildren () != rhs.getNumChildren ())
+        return false;
+
+    for (int i { 0 }; i < lhs.getNumProperties (); ++i)
+    {
+        const auto name { lhs.getPropertyName (i) };
+        if (!rhs.hasProperty (name) || !lhs[name].equalsWithSameType (rhs[name]))
+            return false;
+    }
+
+    for (int i { 0 }; i < lhs.getNumChildren (); ++i)
+    {
+        if (!hasSameContent (lhs.getChild (i), rhs.getChild (i)))
+            return false;
+    }
+    return true;
+}
+} // namespace
+
+class Test_Diff : public TestSuite
+{
+public:
+    Test_Diff ()
+    : TestSuite ("diff", "cello")
+    {
+    }
+
+    void runTest () override
+    {
+        test ("properties",
+              [&] ()
+              {
+                  juce::ValueTree target { "thing" };
+                  target.setProperty ("a", 1, nullptr);
+                  target.setProperty ("b", 2, nullptr);
+                  target.setProperty ("c", "three", nullptr);
+
+                  juce::ValueTree source { "thing" };
+                  source.setProperty ("b", 2, nullptr);
+                  source.setProperty ("c", 3, nullptr);
+                  source.setProperty ("d", 4.0, nullptr);
+
+                  cello::Diff diff;
+                  diff.apply (target, source);
+                  expect (hasSameContent (target, source));
+                  // a string and an int aren't the same value.
+                  expectEquals (diff.getStats ().propertiesSet, 2);
+                  expectEquals (diff.getStats ().propertiesRemoved, 1);
+                  expectEquals (diff.getStats ().getTotal (), 3);
+
+                  // no changes the second time.
+                  diff.apply (target, source);
+                  expectEquals (diff.getStats ().getTotal (), 0);
+              });
+
+        test ("children by position",
+              [&] ()
+              {
+                  juce::ValueTree target { "root" };
+                  target.appendChild (juce::ValueTree { "a" }.setProperty ("n", 1, nullptr), nullptr);
+                  target.appendChild (juce::ValueTree { "b" }.setProperty ("n", 2, nullptr), nullptr);
+                  target.appendChild (juce::ValueTree { "a" }.setProperty ("n", 3, nullptr), nullptr);
+
+                  juce::ValueTree source { "root" };
+                  source.appendChild (juce::ValueTree { "c" }, nullptr);
+                  source.appendChild (juce::ValueTree { "a" }.setProperty ("n", 1, nullptr), nullptr);
+                  source.appendChild (juce::ValueTree { "a" }.setProperty ("n", 30, nullptr), nullptr);
+
+                  const auto firstA { target.getChild (0) };
+                  const auto secondA { target.getChild (2) };
+                  cello::Diff diff;
+                  diff.apply (target, source);
+                  expect (hasSameContent (target, source));
+                  expectEquals (diff.getStats ().childrenRemoved, 1);
+                  expectEquals (diff.getStats ().childrenAdded, 1);
+                  expectEquals (diff.getStats ().childrenMoved, 0);
+                  expectEquals (diff.getStats ().propertiesSet, 1);
+                  // the matched children were updated in place.
+                  expect (target.getChild (1) == firstA);
+                  expect (target.getChild (2) == secondA);
+              });
+
+        test ("keyed children",
+              [&] ()
+              {
+                  auto target { makeTable (10) };
+                  auto source { target.createCopy () };
+                  // move the last row to the front, change one value and
+                  // replace one row with a new one.
+                  source.moveChild (9, 0, nullptr);
+                  source.getChild (5).setProperty ("value", -1, nullptr);
+                  source.removeChild (2, nullptr);
+                  source.addChild (makeRow (100, 1000), 2, nullptr);
+
+                  cello::Diff diff { "id" };
+                  diff.apply (target, source);
+                  expect (hasSameContent (target, source));
+                  expectEquals (diff.getStats ().childrenMoved, 1);
+                  expectEquals (diff.getStats ().childrenRemoved, 1);
+                  expectEquals (diff.getStats ().childrenAdded, 1);
+                  expectEquals (diff.getStats ().propertiesSet, 1);
+
+                  // reversing the order takes one move less than the number of rows.
+                  auto reversed { juce::ValueTree { "table" } };
+                  for (int i { target.getNumChildren () - 1 }; i >= 0; --i)
+                      reversed.appendChild (target.getChild (i).createCopy (), nullptr);
+                  diff.apply (target, reversed);
+                  expect (hasSameContent (target, reversed));
+                  expectEquals (diff.getStats ().childrenMoved, target.getNumChildren () - 1);
+                  expectEquals (diff.getStats ().getTotal (), target.getNumChildren () - 1);
+              });
+
+        test ("nested",
+              [&] ()
+              {
+                  auto target { makeTable (3) };
+                  target.getChild (1).appendChild (makeTable (4), nullptr);
+                  auto source { target.createCopy () };
+                  source.getChild (1).getChild (0).getChild (3).setProperty ("value", 99, nullptr);
+
+                  cello::Diff diff { "id" };
+                  diff.apply (target, source);
+                  expect (hasSameContent (target, source));
+                  expectEquals (diff.getStats ().getTotal (), 1);
+              });
+
+        test ("patches",
+              [&] ()
+              {
+                  auto target { makeTable (20) };
+                  auto replica { target.createCopy () };
+                  auto source { target.createCopy () };
+                  source.moveChild (3, 15, nullptr);
+                  source.removeChild (7, nullptr);
+                  source.getChild (10).setProperty ("value", "changed", nullptr);
+                  source.getChild (11).removeProperty ("value", nullptr);
+                  source.appendChild (makeRow (50, 5), nullptr);
+                  source.getChild (0).appendChild (makeTable (2), nullptr);
+
+                  const auto patch { cello::Diff { "id" }.apply (target, source) };
+                  expect (patch.getSize () > 0);
+                  expect (cello::Diff::applyPatch (replica, patch));
+                  expect (hasSameContent (replica, source));
+                  expect (replica.isEquivalentTo (target));
+
+                  // a truncated patch is rejected.
+                  juce::MemoryOutputStream bogus;
+                  bogus << patch;
+                  bogus.writeCompressedInt (100);
+                  bogus.writeByte (1);
+                  auto other { makeTable (20) };
+                  expect (!cello::Diff::applyPatch (other, bogus.getMemoryBlock ()));
+              });
+
+        test ("assignMinimal",
+              [&] ()
+              {
+                  cello::Object table { "table", makeTable (50) };
+                  cello::Object replica { "table", juce::ValueTree (table).createCopy () };
+                  juce::UndoManager undo;
+                  table.setUndoManager (&undo);
+
+                  int structureChanges { 0 };
+                  auto countChange = [&structureChanges] (juce::ValueTree&, int, int) { ++structureChanges; };
+                  table.onChildAdded   = countChange;
+                  table.onChildRemoved = countChange;
+                  table.onChildMoved   = countChange;
+
+                  cello::Object edited { "table", juce::ValueTree (table).createCopy () };
+                  juce::ValueTree (edited).getChild (25).setProperty ("value", 0, nullptr);
+
+                  undo.beginNewTransaction ();
+                  const auto patch { table.assignMinimal (edited, "id") };
+                  expectEquals (structureChanges, 0);
+                  expect (hasSameContent (table, edited));
+
+                  expect (replica.applyPatch (patch));
+                  expect (hasSameContent (replica, edited));
+
+                  expect (table.undo ());
+                  expectEquals (static_cast<int> (juce::ValueTree (table).getChild (25)["value"]), 250);
+
+                  // compare with a wholesale copy.
+                  table = edited;
+                  expect (structureChanges > 0);
+              });
+    }
+};
+
+static Test_Diff testDiff;
@@ -0,0 +1,252 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#include <juce_core/juce_core.h>
+
+#include "../cello_hash.h"
+#include "../cello_object.h"
+
+namespace
+{
+juce::ValueTree makeHashedTable (int rowCount)
+{
+    juce::ValueTree table { "table" };
+    for (int i { 0 }; i < rowCount; ++i)
+    {
+        juce::ValueTree row { "row" };
+        row.setProperty ("id", i, nullptr);
+        row.setProperty ("value", i * 10, nullptr);
+        row.appendChild (juce::ValueTree { "detail" }.setProperty ("text", juce::String (i), nullptr), nullptr);
+        table.appendChild (row, nullptr);
+    }
+    return table;
+}
+} // namespace
+
+class Test_ContentHash : public TestSuite
+{
+public:
+    Test_ContentHash ()
+    : TestSuite ("content_hash", "cello")
+    {
+    }
+
+    void runTest () override
+    {
+        test ("values",
+              [&] ()
+              {
+                  juce::ValueTree a { "thing" };
+                  a.setProperty ("x", 1, nullptr);
+                  a.setProperty ("y", "two", nullptr);
+
+                  juce::ValueTree b { "thing" };
+                  b.setProperty ("y", "two", nullptr);
+                  b.setProperty ("x", 1, nullptr);
+                  // property order doesn't matter...
+                  expectEquals (cello::ContentHash::calculate (a), cello::ContentHash::calculate (b));
+
+                  // ...but types do.
+                  b.setProperty ("x", "1", nullptr);
+                  expect (cello::ContentHash::calculate (a) != cello::ContentHash::calculate (b));
+                  expect (cello::ContentHash::calculate (juce::var (1)) !=
+                          cello::ContentHash::calculate (juce::var (1.0)));
+
+                  // ...as do the tree's type and the order of children.
+                  juce::ValueTree c { "other" };
+                  c.copyPropertiesFrom (a, nullptr);
+                  expect (cello::ContentHash::calculate (a) != cello::ContentHash::calculate (c));
+
+                  juce::ValueTree parent1 { "parent" };
+                  parent1.appendChild (a.createCopy (), nullptr);
+                  parent1.appendChild (c.createCopy (), nullptr);
+                  juce::ValueTree parent2 { "parent" };
+                  parent2.appendChild (c.createCopy (), nullptr);
+                  parent2.appendChild (a.createCopy (), nullptr);
+                  expect (cello::ContentHash::calculate (parent1) != cello::ContentHash::calculate (parent2));
+                  parent2.moveChild (1, 0, nullptr);
+                  expectEquals (cello::ContentHash::calculate (parent1), cello::ContentHash::calculate (parent2));
+              });
+
+        test ("incremental",
+              [&] ()
+              {
+                  auto table { makeHashedTable (10) };
+                  cello::ContentHash hash { table };
+                  expectEquals (hash.get (), cello::ContentHash::calculate (table));
+
+                  auto checkHash = [&] (const juce::String& step)
+                  {
+                      expectEquals (hash.get (), cello::ContentHash::calculate (table), step);
+                      const auto row { table.getChild (table.getNumChildren () / 2) };
+                      expectEquals (hash.get (row), cello::ContentHash::calculate (row), step);
+                  };
+
+                  table.getChild (3).getChild (0).setProperty ("text", "changed", nullptr);
+                  checkHash ("grandchild property");
+                  table.getChild (4).removeProperty ("value", nullptr);
+                  checkHash ("removed property");
+                  table.appendChild (juce::ValueTree { "row" }.setProperty ("id", 100, nullptr), nullptr);
+                  checkHash ("added child");
+                  table.getChild (2).appendChild (juce::ValueTree { "detail" }, nullptr);
+                  checkHash ("added grandchild");
+                  table.removeChild (0, nullptr);
+                  checkHash ("removed child");
+                  table.moveChild (0, 7, nullptr);
+                  checkHash ("moved child");
+                  table.getChild (1).removeAllChildren (nullptr);
+                  checkHash ("removed grandchildren");
+
+                  // a tree outside the one we're tracking is calculated on demand.
+                  const auto other { makeHashedTable (2) };
+                  expectEquals (hash.get (other), cello::ContentHash::calculate (other));
+
+                  hash.setTree (other);
+                  expectEquals (hash.get (), cello::ContentHash::calculate (other));
+              });
+
+        test ("wide tree",
+              [&] ()
+              {
+                  const int rowCount { 20000 };
+                  auto table { makeHashedTable (rowCount) };
+                  cello::ContentHash hash { table };
+                  hash.get ();
+
+                  // each change finds its row without searching its siblings.
+                  for (int i { 0 }; i < rowCount; ++i)
+                  {
+                      table.getChild (rowCount - 1 - i).getChild (0).setProperty ("text", "changed", nullptr);
+                      hash.get (table.getChild (rowCount - 1 - i));
+                  }
+                  expectEquals (hash.get (), cello::ContentHash::calculate (table));
+
+                  // a row that's been removed is no longer part of the hash.
+                  auto removed { table.getChild (0) };
+                  table.removeChild (removed, nullptr);
+                  const auto afterRemoval { hash.get () };
+                  removed.setProperty ("value", -1, nullptr);
+                  expectEquals (hash.get (), afterRemoval);
+                  expectEquals (hash.get (removed), cello::ContentHash::calculate (removed));
+              });
+
+#if 0
+        // re-enable this to time incremental hashing of a wide tree.
+        test ("wide tree timing",
+              [&] ()
+              {
+                  const int rowCount { 20000 };
+                  auto table { makeHashedTable (rowCount) };
+                  cello::ContentHash hash { table };
+                  hash.get ();
+
+                  const auto start { juce::Time::getMillisecondCounterHiRes () };
+                  for (int i { 0 }; i < rowCount; ++i)
+                  {
+                      table.getChild (rowCount - 1 - i).getChild (0).setProperty ("text", "changed", nullptr);
+                      hash.get (table.getChild (rowCount - 1 - i));
+                  }
+                  const auto elapsed { juce::Time::getMillisecondCounterHiRes () - start };
+                  DBG ("ContentHash: " << rowCount << " changes to a tree of " << rowCount << " rows in " << elapsed
+                                       << " ms");
+                  juce::ignoreUnused (elapsed);
+              });
+#endif
+
+        test ("object content",
+              [&] ()
+              {
+                  cello::Object a { "table", makeHashedTable (5) };
+                  cello::Object b { "table", makeHashedTable (5) };
+                  a.trackContentHash (true);
+                  expect (a.hasSameContent (b));
+
+                  juce::ValueTree { a }.getChild (2).setProperty ("value", -1, nullptr);
+                  expect (!a.hasSameContent (b));
+                  juce::ValueTree { b }.getChild (2).setProperty ("value", -1, nullptr);
+                  expect (a.hasSameContent (b));
+
+                  // the cache keeps up with wholesale changes, too.
+                  a = cello::Object { "table", makeHashedTable (3) };
+                  expectEquals (a.getContentHash (), cello::ContentHash::calculate (makeHashedTable (3)));
+              });
+
+        test ("deep upsert of identical content",
+              [&] ()
+              {
+                  cello::Object table { "table", makeHashedTable (5) };
+                  table.trackContentHash (true);
+                  // a deep copy replaces all of a child's children.
+                  const auto detail0 { juce::ValueTree { table }.getChild (0).getChild (0) };
+                  const auto detail1 { juce::ValueTree { table }.getChild (1).getChild (0) };
+
+                  auto source { makeHashedTable (5) };
+                  const cello::Object same { "table", source };
+                  table.upsertAll (&same, "id", true);
+                  expect (detail0.getParent ().isValid ());
+                  expect (detail1.getParent ().isValid ());
+
+                  source.getChild (1).getChild (0).setProperty ("text", "new", nullptr);
+                  const cello::Object changed { "table", source };
+                  table.upsertAll (&changed, "id", true);
+                  expect (detail0.getParent ().isValid ());
+                  expect (!detail1.getParent ().isValid ());
+                  expectEquals (table.getContentHash (), cello::ContentHash::calculate (source));
+              });
+
+        test ("manifest",
+              [&] ()
+              {
+                  auto local { makeHashedTable (8) };
+                  auto remote { local.createCopy () };
+                  remote.getChild (3).setProperty ("value", -1, nullptr);
+                  remote.removeChild (7, nullptr);
+                  remote.setProperty ("name", "remote", nullptr);
+
+                  // the remote end tells us what it has...
+                  juce::MemoryOutputStream output;
+                  cello::ContentManifest::create (remote).writeToStream (output);
+                  juce::MemoryInputStream input { output.getMemoryBlock (), false };
+                  cello::ContentManifest manifest;
+                  expect (cello::ContentManifest::readFromStream (input, manifest));
+                  expectEquals (manifest.treeHash, cello::ContentHash::calculate (remote));
+                  expectEquals (manifest.childHashes.size (), 7);
+
+                  // ...and we send it only what's different.
+                  const auto updates { manifest.createUpdates (local) };
+                  // one for the removed property, one each to remove and replace
+                  // the changed child, and one to add the missing child.
+                  expectEquals (static_cast<int> (updates.size ()), 4);
+                  for (const auto& update : updates)
+                      juce::ValueTreeSynchroniser::applyChange (remote, update.getData (), update.getSize (), nullptr);
+                  expectEquals (cello::ContentHash::calculate (remote), cello::ContentHash::calculate (local));
+
+                  // nothing to send when we match.
+                  expect (cello::ContentManifest::create (remote).createUpdates (local).empty ());
+
+                  // a truncated manifest is rejected.
+                  juce::MemoryInputStream truncated { output.getData (), output.getDataSize () / 2, false };
+                  expect (!cello::ContentManifest::readFromStream (truncated, manifest));
+              });
+    }
+
+private:
+};
+
+static Test_ContentHash testContentHash;
@@ -2,6 +2,159 @@
 
 #include <juce_core/juce_core.h>
 
+namespace
+{
+/**
+ * @brief One end of a socket or pipe connection that counts the messages it
+ * receives, on its own thread.
+ */
+class CountingConnection : public juce::InterprocessConnection
+{
+public:
+    CountingConnection ()
+    : juce::InterprocessConnection (false)
+    {
+    }
+
+    ~CountingConnection () override { disconnect (); }
+
+    void connectionMade () override {}
+    void connectionLost () override {}
+    void messageReceived (const juce::MemoryBlock&) override { ++received; }
+
+    std::atomic<int> received { 0 };
+};
+
+class CountingServer : public juce::InterprocessConnectionServer
+{
+public:
+    ~CountingServer () override { stop (); }
+
+    juce::InterprocessConnection* createConnectionObject () override
+    {
+        connection = std::make_unique<CountingConnection> ();
+        accepted   = connection.get ();
+        return connection.get ();
+    }
+
+    std::unique_ptr<CountingConnection> connection;
+    /// published separately so the test thread can poll it without racing
+    /// the server thread's write to `connection`.
+    std::atomic<CountingConnection*> accepted { nullptr };
+};
+
+/**
+ * @brief Keeps a copy of each change made to a tree, encoded the way an
+ * IpcClient sends it.
+ */
+class ChangeRecorder : public juce::ValueTreeSynchroniser
+{
+public:
+    explicit ChangeRecorder (const juce::ValueTree& tree)
+    : juce::ValueTreeSynchroniser (tree)
+    {
+    }
+
+    void stateChanged (const void* encodedChange, size_t encodedSize) override
+    {
+        changes.emplace_back (encodedChange, encodedSize);
+    }
+
+    std::vector<juce::MemoryBlock> changes;
+};
+
+struct IpcTestObject : public cello::Object
+{
+    IpcTestObject ()
+    : cello::Object ("ipcTest", nullptr)
+    {
+    }
+
+    MAKE_VALUE_MEMBER (int, x, 0);
+};
+
+/**
+ * @return a sequenced update, framed the way an IpcClient or IpcServer sends it.
+ */
+juce::MemoryBlock makeSequencedUpdate (juce::uint32 origin, juce::int64 sequence, const juce::MemoryBlock& change)
+{
+    juce::MemoryOutputStream output;
+    writeSequencedHeader (output, ControlMessage::sequencedUpdate, origin, sequence);
+    output << change;
+    return output.getMemoryBlock ();
+}
+
+#if JUCE_MODAL_LOOPS_PERMITTED
+/**
+ * @brief Run the message loop until `done()` or we give up.
+ *
+ * @return true if `done()`.
+ */
+template <typename Fn> bool runMessageLoopUntil (Fn&& done, int msTimeout = 2000)
+{
+    const auto start { juce::Time::getMillisecondCounter () };
+    while (!done ())
+    {
+        if (juce::Time::getMillisecondCounter () - start > static_cast<juce::uint32> (msTimeout))
+            return false;
+        juce::MessageManager::getInstance ()->runDispatchLoopUntil (10);
+    }
+    return true;
+}
+#endif
+
+/**
+ * @brief Counts the changes made to a tree that are (and aren't) the echo of
+ * the change being applied to it.
+ */
+class EchoCounter : public juce::ValueTreeSynchroniser
+{
+public:
+    EchoCounter (const juce::ValueTree& tree, cello::UpdateTag& applying)
+    : juce::ValueTreeSynchroniser (tree)
+    , tag (applying)
+    {
+    }
+
+    void stateChanged (const void* encodedChange, size_t encodedSize) override
+    {
+        if (tag.isEcho (encodedChange, encodedSize))
+            ++echoes;
+        else
+            ++changes;
+    }
+
+    cello::UpdateTag& tag;
+    int echoes { 0 };
+    int changes { 0 };
+};
+
+/**
+ * @brief Send `messageCount` messages of `messageSize` bytes and wait for them
+ * all to arrive.
+ *
+ * @return elapsed ms, or -1 if they didn't all arrive.
+ */
+template <typename SendFn>
+double timeLoopback (int messageCount, size_t messageSize, SendFn&& sendFn, const std::atomic<int>& received)
+{
+    juce::MemoryBlock message { messageSize, true };
+    const auto start { juce::Time::getMillisecondCounterHiRes () };
+    for (int i { 0 }; i < messageCount; ++i)
+    {
+        if (!sendFn (message))
+            return -1;
+    }
+    while (received.load () < messageCount)
+    {
+        if (juce::Time::getMillisecondCounterHiRes () - start > 10000)
+            return -1;
+        juce::Thread::yield ();
+    }
+    return juce::Time::getMillisecondCounterHiRes () - start;
+}
+} // namespace
+
 class Test_cello_ipc : public TestSuite
 {
 public:
@@ -10,7 +163,597 @@ public:
     {
     }
 
-    void runTest () override { beginTest ("Not sure how to unit test IPC calls..."); }
+    void runTest () override
+    {
+        beginTest ("Not sure how to unit test IPC calls...");
+
+        test ("sequence tracking",
+              [this] ()
+              {
+                  using Result = cello::SequenceTracker::Result;
+                  cello::SequenceTracker tracker;
+                  // the first update from a sender sets our expectations.
+                  expect (tracker.check (1, 10) == Result::apply);
+                  expect (tracker.check (1, 11) == Result::apply);
+                  expect (tracker.check (1, 11) == Result::duplicate);
+                  expect (tracker.check (1, 5) == Result::duplicate);
+                  expect (tracker.check (1, 13) == Result::gap);
+                  expectEquals (tracker.getGapCount (), 1);
+                  // a gap isn't accepted...
+                  expectEquals (tracker.getLastSequence (), juce::int64 { 11 });
+                  expect (tracker.check (1, 14) == Result::gap);
+                  // ...until we've been brought up to date.
+                  tracker.reset (1, 20);
+                  expect (tracker.check (1, 21) == Result::apply);
+
+                  // a different sender starts over.
+                  expect (tracker.check (2, 1) == Result::apply);
+                  expect (tracker.check (2, 2) == Result::apply);
+                  expectEquals (tracker.getGapCount (), 2);
+              });
+
+        test ("replay log",
+              [this] ()
+              {
+                  const auto makeUpdate = [] (int size) { return juce::MemoryBlock (static_cast<size_t> (size), true); };
+                  std::vector<size_t> sent;
+                  const auto send = [&sent] (const juce::MemoryBlock& message) { sent.push_back (message.getSize ()); };
+
+                  cello::ReplayLog log;
+                  log.setMaxBytes (100);
+                  for (int i { 1 }; i <= 5; ++i)
+                      log.add (i, makeUpdate (10 + i));
+                  expectEquals (log.getSize (), size_t { 11 + 12 + 13 + 14 + 15 });
+
+                  // a receiver that's up to date needs nothing.
+                  expect (log.replay (5, send));
+                  expect (sent.empty ());
+                  // one that missed some gets only those, in order.
+                  expect (log.replay (2, send));
+                  expectEquals (static_cast<int> (sent.size ()), 3);
+                  expectEquals (sent[0], size_t { 13 });
+                  expectEquals (sent[2], size_t { 15 });
+
+                  // the oldest updates are forgotten to make room.
+                  log.add (6, makeUpdate (60));
+                  sent.clear ();
+                  expect (!log.replay (2, send));
+                  expect (sent.empty ());
+                  expect (log.replay (3, send));
+                  expectEquals (static_cast<int> (sent.size ()), 3);
+                  expect (log.getSize () <= log.getMaxBytes ());
+
+                  // a gap in the sequence starts the log over.
+                  log.add (9, makeUpdate (10));
+                  expect (!log.replay (6, send));
+                  expect (log.replay (8, send));
+                  // (and so does an update that's too big to keep.)
+                  log.add (10, makeUpdate (200));
+                  expect (!log.replay (9, send));
+                  expectEquals (log.getSize (), size_t { 0 });
+
+                  // the sender that a change came from is only replayed its
+                  // header; everyone else gets all of it.
+                  log.add (11, makeUpdate (20), 42, 8);
+                  log.add (12, makeUpdate (20));
+                  sent.clear ();
+                  expect (log.replay (10, send, 42));
+                  expectEquals (static_cast<int> (sent.size ()), 2);
+                  expectEquals (sent[0], size_t { 8 });
+                  expectEquals (sent[1], size_t { 20 });
+                  sent.clear ();
+                  expect (log.replay (10, send, 7));
+                  expectEquals (sent[0], size_t { 20 });
+              });
+
+        test ("resuming after a missed update",
+              [this] ()
+              {
+                  IpcTestObject source;
+                  ChangeRecorder recorder { source };
+                  for (int i { 1 }; i <= 6; ++i)
+                      source.x = i;
+                  const auto& changes { recorder.changes };
+                  expectEquals (static_cast<int> (changes.size ()), 6);
+
+                  // (never connected; we deliver its messages ourselves.)
+                  IpcTestObject dest;
+                  cello::IpcClient receiver { dest, "cello_test_unconnected", 0, cello::IpcClient::receive };
+                  auto& connection { static_cast<juce::InterprocessConnection&> (receiver) };
+                  const juce::uint32 origin { 7 };
+
+                  connection.messageReceived (makeSequencedUpdate (origin, 1, changes[0]));
+                  receiver.performAllUpdates ();
+                  expectEquals ((int) dest.x, 1);
+
+                  // after missing update 2, nothing is applied...
+                  connection.messageReceived (makeSequencedUpdate (origin, 3, changes[2]));
+                  connection.messageReceived (makeSequencedUpdate (origin, 4, changes[3]));
+                  receiver.performAllUpdates ();
+                  expectEquals ((int) dest.x, 1);
+
+                  // ...until the sender replays the updates it missed.
+                  connection.messageReceived (makeSequencedUpdate (origin, 2, changes[1]));
+                  connection.messageReceived (makeSequencedUpdate (origin, 3, changes[2]));
+                  connection.messageReceived (makeSequencedUpdate (origin, 4, changes[3]));
+                  receiver.performAllUpdates ();
+                  expectEquals ((int) dest.x, 4);
+
+                  // an update without a change (our own, echoed by a server)
+                  // moves the sequence on without leaving a gap.
+                  connection.messageReceived (makeSequencedUpdate (origin, 5, {}));
+                  connection.messageReceived (makeSequencedUpdate (origin, 6, changes[5]));
+                  receiver.performAllUpdates ();
+                  expectEquals ((int) dest.x, 6);
+              });
+
+#if JUCE_MODAL_LOOPS_PERMITTED
+        test ("resuming a connection to a server",
+              [this] ()
+              {
+                  // the connections call back on the message thread.
+                  if (!juce::MessageManager::existsAndIsCurrentThread ())
+                      return;
+
+                  IpcTestObject serverTree;
+                  IpcTestObject clientTree;
+                  // (the server doesn't send a full update on connecting, so
+                  // only its replay log can bring the client up to date.)
+                  cello::IpcServer server { serverTree, cello::IpcClient::send, "ipcServer" };
+                  server.setReplayLog (4096);
+                  expect (server.startServer (0, "127.0.0.1"));
+                  cello::IpcClient client { clientTree, "127.0.0.1", server.getBoundPort (), 1000,
+                                            cello::IpcClient::receive };
+
+                  expect (client.connect ());
+                  // (give the server's end time to read our manifest.)
+                  runMessageLoopUntil ([] () { return false; }, 100);
+                  serverTree.x = 1;
+                  expect (runMessageLoopUntil ([&clientTree] () { return clientTree.x == 1; }));
+
+                  client.disconnect ();
+                  runMessageLoopUntil ([] () { return false; }, 100);
+                  serverTree.x = 2;
+                  serverTree.x = 3;
+
+                  expect (client.connect ());
+                  expect (runMessageLoopUntil ([&clientTree] () { return clientTree.x == 3; }));
+                  expectEquals ((int) clientTree.x, 3);
+                  server.stopServer ();
+              });
+
+        test ("server relays changes between clients",
+              [this] ()
+              {
+                  if (!juce::MessageManager::existsAndIsCurrentThread ())
+                      return;
+
+                  const auto both { static_cast<cello::IpcClient::UpdateType> (cello::IpcClient::send |
+                                                                               cello::IpcClient::receive) };
+                  IpcTestObject serverTree;
+                  IpcTestObject treeA;
+                  IpcTestObject treeB;
+                  cello::Object stateA { "stateA", nullptr };
+                  cello::Object stateB { "stateB", nullptr };
+                  cello::IpcServer server { serverTree, both, "ipcServer" };
+                  expect (server.startServer (0, "127.0.0.1"));
+                  cello::IpcClient clientA { treeA, "127.0.0.1", server.getBoundPort (), 1000, both, &stateA };
+                  cello::IpcClient clientB { treeB, "127.0.0.1", server.getBoundPort (), 1000, both, &stateB };
+                  cello::IpcClientProperties propertiesA { "ipcTest", &stateA };
+                  cello::IpcClientProperties propertiesB { "ipcTest", &stateB };
+
+                  expect (clientA.connect ());
+                  expect (clientB.connect ());
+                  // (give the server's ends time to read our manifests.)
+                  runMessageLoopUntil ([] () { return false; }, 100);
+
+                  // a change made on the server is encoded once and sent to both.
+                  serverTree.x = 1;
+                  expect (runMessageLoopUntil ([&] () { return treeA.x == 1 && treeB.x == 1; }));
+                  const int receivedByA { propertiesA.rxCount };
+
+                  // a change from one client goes to the other, but not back to
+                  // the client it came from (which is only told that the
+                  // sequence moved on.)
+                  treeA.x = 2;
+                  expect (runMessageLoopUntil ([&] () { return serverTree.x == 2 && treeB.x == 2; }));
+                  runMessageLoopUntil ([] () { return false; }, 100);
+                  expectEquals ((int) propertiesA.rxCount, receivedByA);
+                  expectEquals ((int) treeA.x, 2);
+
+                  // ...so the next change from the server isn't taken for a gap.
+                  serverTree.x = 3;
+                  expect (runMessageLoopUntil ([&] () { return treeA.x == 3 && treeB.x == 3; }));
+                  expectEquals ((int) propertiesA.rxCount, receivedByA + 1);
+                  expectEquals ((int) propertiesA.gapCount, 0);
+                  expectEquals ((int) propertiesB.gapCount, 0);
+
+                  // the same goes for a change from the other client.
+                  treeB.x = 4;
+                  expect (runMessageLoopUntil ([&] () { return treeA.x == 4 && serverTree.x == 4; }));
+                  serverTree.x = 5;
+                  expect (runMessageLoopUntil ([&] () { return treeA.x == 5 && treeB.x == 5; }));
+                  expectEquals ((int) propertiesA.gapCount, 0);
+                  expectEquals ((int) propertiesB.gapCount, 0);
+
+                  clientA.disconnect ();
+                  clientB.disconnect ();
+                  server.stopServer ();
+              });
+#endif
+
+        test ("batched updates",
+              [this] ()
+              {
+                  cello::Object source { "batch", nullptr };
+                  cello::Object replica { "batch", nullptr };
+                  ChangeRecorder recorder { source };
+                  source.setattr ("a", 1);
+                  source.setattr ("b", juce::String ("two"));
+                  source.setattr ("a", 3);
+
+                  juce::MemoryOutputStream batch;
+                  writeSequencedHeader (batch, ControlMessage::batchedUpdate, 1, 1);
+                  batch.writeInt (static_cast<int> (recorder.changes.size ()));
+                  for (const auto& change : recorder.changes)
+                  {
+                      batch.writeCompressedInt (static_cast<int> (change.getSize ()));
+                      batch.write (change.getData (), change.getSize ());
+                  }
+                  expect (isBatch (batch.getData (), batch.getDataSize ()));
+                  expect (!isBatch (recorder.changes[0].getData (), recorder.changes[0].getSize ()));
+
+                  // the changes are unpacked in order.
+                  const auto count { forEachBatchedChange (batch.getData (), batch.getDataSize (),
+                                                           [&replica] (const void* change, size_t size)
+                                                           { replica.update (change, size); }) };
+                  expectEquals (count, 3);
+                  expectEquals (replica.getattr ("a", 0), 3);
+                  expectEquals (replica.getattr ("b", juce::String ()), juce::String ("two"));
+
+                  // tagged as it's applied, each change in the batch is recognized
+                  // as an echo, once; a change that it causes isn't.
+                  cello::Object echoing { "batch", nullptr };
+                  cello::UpdateTag tag;
+                  EchoCounter counter { echoing, tag };
+                  echoing.onPropertyChange ("a",
+                                            [&echoing] (const juce::Identifier&)
+                                            {
+                                                if (echoing.getattr ("a", 0) == 3)
+                                                    echoing.setattr ("c", true);
+                                            });
+                  forEachBatchedChange (batch.getData (), batch.getDataSize (),
+                                        [&] (const void* change, size_t size)
+                                        {
+                                            tag = cello::UpdateTag { change, size };
+                                            echoing.update (change, size);
+                                            expect (!tag.isEcho (change, size));
+                                        });
+                  expectEquals (counter.echoes, 3);
+                  expectEquals (counter.changes, 1);
+              });
+
+        test ("compressed messages",
+              [this] ()
+              {
+                  juce::MemoryOutputStream original;
+                  for (int i { 0 }; i < 1000; ++i)
+                      original.writeString ("property" + juce::String (i % 10));
+
+                  juce::MemoryOutputStream compressed;
+                  compressed.writeByte (static_cast<char> (ControlMessage::compressedMessage));
+                  compressed.writeInt (static_cast<int> (original.getDataSize ()));
+                  {
+                      juce::GZIPCompressorOutputStream zipper { compressed, 1 };
+                      zipper.write (original.getData (), original.getDataSize ());
+                  }
+                  expectLessThan (compressed.getDataSize (), original.getDataSize ());
+
+                  juce::MemoryBlock inflated;
+                  expect (decompress (compressed.getMemoryBlock (), inflated));
+                  expect (inflated == original.getMemoryBlock ());
+
+                  // a message whose size doesn't match the one it claims is
+                  // rejected, without allocating the size it claims.
+                  auto wrongSize = [&] (int claimedSize)
+                  {
+                      auto message { compressed.getMemoryBlock () };
+                      juce::MemoryOutputStream header { message.getData (), 5 };
+                      header.writeByte (static_cast<char> (ControlMessage::compressedMessage));
+                      header.writeInt (claimedSize);
+                      return message;
+                  };
+                  expect (!decompress (wrongSize (std::numeric_limits<int>::max ()), inflated));
+                  expect (!decompress (wrongSize (static_cast<int> (original.getDataSize ()) - 1), inflated));
+              });
+
+        test ("shared memory channel",
+              [this] ()
+              {
+                  const auto name { "cello_test_" + juce::String::toHexString (juce::Random::getSystemRandom ().nextInt ()) };
+                  cello::SharedMemoryChannel creator { name, 256, false };
+                  cello::SharedMemoryChannel opener { name, 256, false };
+                  // nobody's there yet.
+                  expect (!opener.open (0));
+                  expect (creator.create (true));
+                  expect (!creator.isConnected ());
+                  expect (opener.open (1000));
+                  expect (creator.isConnected ());
+                  expect (opener.isConnected ());
+
+                  juce::CriticalSection lock;
+                  juce::Array<juce::MemoryBlock> messages;
+                  opener.onMessage = [&] (const juce::MemoryBlock& message)
+                  {
+                      const juce::ScopedLock scopedLock { lock };
+                      messages.add (message);
+                  };
+
+                  // small messages, and ones much larger than the ring.
+                  juce::MemoryBlock small { "cello", 5 };
+                  juce::MemoryBlock large { 10000, false };
+                  for (size_t i { 0 }; i < large.getSize (); ++i)
+                      large[i] = static_cast<char> (i);
+                  expect (creator.sendMessage (small.getData (), small.getSize ()));
+                  expect (creator.sendMessage (large.getData (), large.getSize ()));
+                  expect (creator.sendMessage (nullptr, 0));
+
+                  for (int i { 0 }; i < 1000; ++i)
+                  {
+                      {
+                          const juce::ScopedLock scopedLock { lock };
+                          if (messages.size () == 3)
+                              break;
+                      }
+                      juce::Thread::sleep (1);
+                  }
+                  const juce::ScopedLock scopedLock { lock };
+                  expectEquals (messages.size (), 3);
+                  expect (messages[0] == small);
+                  expect (messages[1] == large);
+                  expectEquals (static_cast<int> (messages[2].getSize ()), 0);
+
+                  opener.close ();
+                  expect (!creator.isConnected ());
+
+                  // creating a channel that's already there joins it.
+                  cello::SharedMemoryChannel joiner { name, 256, false };
+                  expect (joiner.create (false));
+                  expect (creator.isConnected ());
+                  expect (joiner.isConnected ());
+                  joiner.close ();
+                  expect (cello::SharedMemoryChannel::getSegmentFile (name).exists ());
+
+                  creator.close ();
+                  expect (!cello::SharedMemoryChannel::getSegmentFile (name).exists ());
+              });
+
+#if JUCE_MODAL_LOOPS_PERMITTED
+        test ("clients over shared memory",
+              [this] ()
+              {
+                  // the channel calls back on the message thread.
+                  if (!juce::MessageManager::existsAndIsCurrentThread ())
+                      return;
+
+                  const cello::IpcClient::SharedMemory channel {
+                      "cello_test_" + juce::String::toHexString (juce::Random::getSystemRandom ().nextInt ()), 4096
+                  };
+                  IpcTestObject sourceTree;
+                  IpcTestObject replicaTree;
+                  sourceTree.x = 5;
+                  cello::IpcClient sender { sourceTree, channel, 0,
+                                            static_cast<cello::IpcClient::UpdateType> (
+                                                cello::IpcClient::send | cello::IpcClient::fullUpdateOnConnect) };
+                  cello::IpcClient receiver { replicaTree, channel, 1000, cello::IpcClient::receive };
+                  expect (sender.connect (cello::IpcClient::createOrFail));
+                  expect (receiver.connect (cello::IpcClient::mustExist));
+                  expect (receiver.isConnected ());
+
+                  // the receiving end is brought up to date when it connects...
+                  expect (runMessageLoopUntil ([&replicaTree] () { return replicaTree.x == 5; }));
+                  // ...and then gets each change.
+                  sourceTree.x = 6;
+                  expect (runMessageLoopUntil ([&replicaTree] () { return replicaTree.x == 6; }));
+
+                  // it doesn't send its own changes.
+                  replicaTree.x = 100;
+                  runMessageLoopUntil ([] () { return false; }, 100);
+                  expectEquals ((int) sourceTree.x, 6);
+
+                  receiver.disconnect ();
+                  expect (!receiver.isConnected ());
+                  expect (runMessageLoopUntil ([&sender] () { return !sender.isConnected (); }));
+              });
+
+        test ("batching a client's changes",
+              [this] ()
+              {
+                  if (!juce::MessageManager::existsAndIsCurrentThread ())
+                      return;
+
+                  const cello::IpcClient::SharedMemory channel {
+                      "cello_test_" + juce::String::toHexString (juce::Random::getSystemRandom ().nextInt ()), 4096
+                  };
+                  // both ends send, so an echo of the batch would come back.
+                  const auto both { static_cast<cello::IpcClient::UpdateType> (cello::IpcClient::send |
+                                                                               cello::IpcClient::receive) };
+                  IpcTestObject sourceTree;
+                  IpcTestObject replicaTree;
+                  cello::Object sourceState { "sourceState", nullptr };
+                  cello::Object replicaState { "replicaState", nullptr };
+                  cello::IpcClient sender { sourceTree, channel, 0, both, &sourceState };
+                  cello::IpcClient receiver { replicaTree, channel, 1000, both, &replicaState };
+                  cello::IpcClientProperties sent { "ipcTest", &sourceState };
+                  cello::IpcClientProperties received { "ipcTest", &replicaState };
+                  expect (sender.connect (cello::IpcClient::createOrFail));
+                  expect (receiver.connect (cello::IpcClient::mustExist));
+                  runMessageLoopUntil ([] () { return false; }, 100);
+                  const auto wait = [] () { runMessageLoopUntil ([] () { return false; }, 100); };
+
+                  // changes wait in the batch until it's flushed...
+                  sender.setBatching (1 << 20, 60000);
+                  sourceTree.x = 1;
+                  sourceTree.setattr ("name", juce::String ("one"));
+                  sourceTree.x = 2;
+                  wait ();
+                  expectEquals ((int) replicaTree.x, 0);
+                  expectEquals ((int) sent.txCount, 0);
+                  sender.flush ();
+                  // ...and then arrive as one message, applied in order.
+                  expect (runMessageLoopUntil ([&replicaTree] () { return replicaTree.x == 2; }));
+                  expectEquals (replicaTree.getattr ("name", juce::String ()), juce::String ("one"));
+                  expectEquals ((int) sent.txCount, 3);
+                  expectEquals ((int) received.rxCount, 3);
+                  // the receiver applies the whole batch as one update, and
+                  // recognizes each change's echo as it goes, so nothing comes back.
+                  wait ();
+                  expectEquals ((int) sent.rxCount, 0);
+                  expectEquals ((int) received.txCount, 0);
+
+                  // a batch is sent once it's full...
+                  sender.setBatching (256, 60000);
+                  sourceTree.x = 3;
+                  wait ();
+                  expectEquals ((int) replicaTree.x, 2);
+                  sourceTree.setattr ("name", juce::String::repeatedString ("two", 100));
+                  expect (runMessageLoopUntil ([&replicaTree] () { return replicaTree.x == 3; }));
+                  expectEquals (replicaTree.getattr ("name", juce::String ()).length (), 300);
+
+                  // ...or once its first change has waited long enough.
+                  sender.setBatching (1 << 20, 50);
+                  sourceTree.x = 4;
+                  expect (runMessageLoopUntil ([&replicaTree] () { return replicaTree.x == 4; }));
+
+                  // turning batching off sends what's waiting, and then each
+                  // change on its own.
+                  sender.setBatching (1 << 20, 60000);
+                  sourceTree.x = 5;
+                  wait ();
+                  expectEquals ((int) replicaTree.x, 4);
+                  sender.setBatching (0);
+                  expect (runMessageLoopUntil ([&replicaTree] () { return replicaTree.x == 5; }));
+                  sourceTree.x = 6;
+                  expect (runMessageLoopUntil ([&replicaTree] () { return replicaTree.x == 6; }));
+                  expectEquals ((int) sent.rxCount, 0);
+
+                  receiver.disconnect ();
+                  sender.disconnect ();
+              });
+
+        test ("negotiating compression",
+              [this] ()
+              {
+                  if (!juce::MessageManager::existsAndIsCurrentThread ())
+                      return;
+
+                  const cello::IpcClient::SharedMemory channel {
+                      "cello_test_" + juce::String::toHexString (juce::Random::getSystemRandom ().nextInt ()), 4096
+                  };
+                  IpcTestObject sourceTree;
+                  IpcTestObject replicaTree;
+                  cello::Object sourceState { "sourceState", nullptr };
+                  cello::IpcClient sender { sourceTree, channel, 0, cello::IpcClient::send, &sourceState };
+                  cello::IpcClient receiver { replicaTree, channel, 1000, cello::IpcClient::receive };
+                  cello::IpcClientProperties sent { "ipcTest", &sourceState };
+                  sender.setCompression (true, 512);
+                  expect (sender.connect (cello::IpcClient::createOrFail));
+                  expect (receiver.connect (cello::IpcClient::mustExist));
+                  runMessageLoopUntil ([] () { return false; }, 100);
+                  const auto arrived = [&replicaTree] (const juce::String& text)
+                  {
+                      return runMessageLoopUntil ([&] ()
+                                                  { return replicaTree.getattr ("text", juce::String ()) == text; });
+                  };
+
+                  // the other end hasn't offered to compress, so nothing is.
+                  const auto large { juce::String::repeatedString ("cello ", 500) };
+                  sourceTree.setattr ("text", large);
+                  expect (arrived (large));
+                  expectEquals ((int) sent.compressedCount, 0);
+
+                  // once it has, large messages are compressed...
+                  receiver.setCompression (true, 512);
+                  runMessageLoopUntil ([] () { return false; }, 100);
+                  const auto larger { large + "cello" };
+                  sourceTree.setattr ("text", larger);
+                  expect (arrived (larger));
+                  expectEquals ((int) sent.compressedCount, 1);
+                  expectGreaterThan ((double) sent.compressionRatio, 1.0);
+                  expectGreaterThan ((double) sent.compressionMs, 0.0);
+
+                  // ...but ones below the minimum size aren't.
+                  sourceTree.x = 1;
+                  expect (runMessageLoopUntil ([&replicaTree] () { return replicaTree.x == 1; }));
+                  expectEquals ((int) sent.compressedCount, 1);
+
+                  receiver.disconnect ();
+                  sender.disconnect ();
+              });
+#endif
+
+#if 0
+        // re-enable this to compare the speed of the transports.
+        test ("transport benchmark",
+              [this] ()
+              {
+                  const int messageCount { 10000 };
+                  const size_t messageSize { 64 };
+                  const auto name { "cello_bench_" + juce::String::toHexString (juce::Random::getSystemRandom ().nextInt ()) };
+
+                  {
+                      cello::SharedMemoryChannel sender { name, 1 << 20, false };
+                      cello::SharedMemoryChannel receiver { name, 1 << 20, false };
+                      std::atomic<int> received { 0 };
+                      receiver.onMessage = [&received] (const juce::MemoryBlock&) { ++received; };
+                      expect (sender.create (false) && receiver.open (1000));
+                      const auto elapsed { timeLoopback (
+                          messageCount, messageSize,
+                          [&sender] (const juce::MemoryBlock& message)
+                          { return sender.sendMessage (message.getData (), message.getSize ()); },
+                          received) };
+                      expect (elapsed >= 0);
+                      DBG ("shared memory: " << messageCount << " messages in " << elapsed << " ms");
+                      juce::ignoreUnused (elapsed);
+                  }
+
+                  {
+                      CountingConnection sender;
+                      CountingConnection receiver;
+                      expect (receiver.createPipe (name, -1, true) && sender.connectToPipe (name, -1));
+                      const auto elapsed { timeLoopback (
+                          messageCount, messageSize,
+                          [&sender] (const juce::MemoryBlock& message) { return sender.sendMessage (message); },
+                          receiver.received) };
+                      expect (elapsed >= 0);
+                      DBG ("pipe: " << messageCount << " messages in " << elapsed << " ms");
+                      juce::ignoreUnused (elapsed);
+                  }
+
+                  {
+                      CountingServer server;
+                      CountingConnection sender;
+                      expect (server.beginWaitingForSocket (0, "127.0.0.1"));
+                      expect (sender.connectToSocket ("127.0.0.1", server.getBoundPort (), 1000));
+                      // wait for the server to make its end of the connection.
+                      CountingConnection* accepted { nullptr };
+                      for (int i { 0 }; i < 1000 && (accepted = server.accepted.load ()) == nullptr; ++i)
+                          juce::Thread::sleep (1);
+                      expect (accepted != nullptr);
+                      if (accepted != nullptr)
+                      {
+                          const auto elapsed { timeLoopback (
+                              messageCount, messageSize,
+                              [&sender] (const juce::MemoryBlock& message) { return sender.sendMessage (message); },
+                              accepted->received) };
+                          expect (elapsed >= 0);
+                          DBG ("socket: " << messageCount << " messages in " << elapsed << " ms");
+                          juce::ignoreUnused (elapsed);
+                      }
+                  }
+              });
+#endif
+    }
 
 private:
     // !!! test class member vars here...
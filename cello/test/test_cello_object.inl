@@ -116,6 +116,26 @@ public:
     Vec2 size { "size", this };
 };
 
+/**
+ * @brief Counts the property change callbacks it receives, whether or not
+ * they're for its own tree.
+ */
+class CountingObject : public cello::Object
+{
+public:
+    CountingObject (const juce::String& type, juce::ValueTree tree)
+    : cello::Object (type, tree)
+    {
+    }
+
+    void valueTreePropertyChanged (juce::ValueTree& tree, const juce::Identifier& property) override
+    {
+        ++callCount;
+    }
+
+    int callCount { 0 };
+};
+
 struct FourInts
 {
     int one { 1 };
@@ -326,6 +346,123 @@ public:
                   expect (lastIdentifier.toString () == "y");
                   expect (lastValue == 1201);
               });
+        test ("multiple property callbacks",
+              [&] ()
+              {
+                  OneValue ov (0);
+                  juce::String calls;
+                  ov.onPropertyChange (OneValue::valId, [&calls] (juce::Identifier) { calls << "a"; });
+                  const auto tokenB { ov.addPropertyChangeCallback (OneValue::valId,
+                                                                    [&calls] (juce::Identifier) { calls << "b"; }) };
+                  const auto tokenC { ov.addPropertyChangeCallback (OneValue::valId,
+                                                                    [&calls] (juce::Identifier) { calls << "c"; }) };
+                  expect (tokenB != tokenC);
+                  ov.setValue (1);
+                  expectEquals (calls, juce::String ("abc"));
+
+                  // replacing the primary callback leaves the added ones alone.
+                  calls.clear ();
+                  ov.onPropertyChange (OneValue::valId, [&calls] (juce::Identifier) { calls << "A"; });
+                  ov.setValue (2);
+                  expectEquals (calls, juce::String ("Abc"));
+
+                  calls.clear ();
+                  ov.removePropertyChangeCallback (tokenB);
+                  ov.setValue (3);
+                  expectEquals (calls, juce::String ("Ac"));
+
+                  calls.clear ();
+                  ov.onPropertyChange (OneValue::valId, nullptr);
+                  ov.setValue (4);
+                  expectEquals (calls, juce::String ("c"));
+
+                  // an added callback may remove itself while being called.
+                  calls.clear ();
+                  int tokenD { 0 };
+                  tokenD = ov.addPropertyChangeCallback (OneValue::valId,
+                                                         [&] (juce::Identifier)
+                                                         {
+                                                             calls << "d";
+                                                             ov.removePropertyChangeCallback (tokenD);
+                                                         });
+                  ov.setValue (5);
+                  ov.setValue (6);
+                  expectEquals (calls, juce::String ("cdc"));
+
+                  // ...without the callback after it being skipped.
+                  calls.clear ();
+                  int tokenE { 0 };
+                  tokenE = ov.addPropertyChangeCallback (OneValue::valId,
+                                                         [&] (juce::Identifier)
+                                                         {
+                                                             calls << "e";
+                                                             ov.removePropertyChangeCallback (tokenE);
+                                                         });
+                  const auto tokenF { ov.addPropertyChangeCallback (OneValue::valId,
+                                                                    [&calls] (juce::Identifier) { calls << "f"; }) };
+                  ov.setValue (10);
+                  ov.setValue (11);
+                  expectEquals (calls, juce::String ("cefcf"));
+                  ov.removePropertyChangeCallback (tokenF);
+
+                  // once the last callback for a property is gone, the
+                  // generic callback is used again.
+                  calls.clear ();
+                  ov.removePropertyChangeCallback (tokenC);
+                  ov.onPropertyChange ([&calls] (juce::Identifier) { calls << "g"; });
+                  ov.setValue (7);
+                  expectEquals (calls, juce::String ("g"));
+              });
+#if 0
+        // re-enable this to measure the cost of dispatching property changes.
+        test ("property callback dispatch scaling",
+              [&] ()
+              {
+                  const int iterations { 10000 };
+                  // time `iterations` changes to `target`
+                  auto timeChanges = [] (cello::Object& obj, const juce::Identifier& target)
+                  {
+                      const auto startTicks { juce::Time::getHighResolutionTicks () };
+                      for (int i { 0 }; i < iterations; ++i)
+                          obj.setattr (target, i + 1);
+                      return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks () -
+                                                                       startTicks);
+                  };
+
+                  for (int callbackCount : { 10, 100, 1000 })
+                  {
+                      // every callback is registered on one property, and each
+                      // change calls all of them.
+                      cello::Object shared { "bench", nullptr };
+                      const juce::Identifier level { "level" };
+                      shared.setattr (level, 0);
+                      int sharedHits { 0 };
+                      for (int i { 0 }; i < callbackCount; ++i)
+                          shared.onPropertyChange (level, [&sharedHits] (juce::Identifier) { ++sharedHits; });
+                      const auto sharedTime { timeChanges (shared, level) };
+                      expectEquals (sharedHits, iterations * callbackCount);
+
+                      // one callback on each of as many properties; a change
+                      // only finds its own.
+                      cello::Object spread { "bench", nullptr };
+                      int spreadHits { 0 };
+                      for (int i { 0 }; i < callbackCount; ++i)
+                      {
+                          const juce::Identifier id { "p" + juce::String (i) };
+                          spread.setattr (id, 0);
+                          spread.onPropertyChange (id, [&spreadHits] (juce::Identifier) { ++spreadHits; });
+                      }
+                      const auto spreadTime { timeChanges (spread, "p" + juce::String (callbackCount - 1)) };
+                      expectEquals (spreadHits, iterations);
+
+                      DBG (callbackCount << " callbacks on one property: "
+                                         << (sharedTime * 1.0e9 / (iterations * callbackCount))
+                                         << "ns per callback; on separate properties: "
+                                         << (spreadTime * 1.0e9 / iterations) << "ns per property change");
+                      juce::ignoreUnused (sharedTime, spreadTime);
+                  }
+              });
+#endif
         test ("force updates",
               [&] ()
               {
@@ -416,6 +553,57 @@ public:
                   expect (foo.getType ().toString () == "foo");
               });
 
+        test ("compiled types",
+              [this] ()
+              {
+                  cello::Object root ("root", nullptr);
+                  const auto bazPath { cello::CompiledPath::get ("/foo/bar/baz") };
+                  cello::Object baz { bazPath, &root };
+                  expect (baz.getType ().toString () == "baz");
+                  expect (baz.getCreationType () == Object::CreationType::initialized);
+                  // the same compiled path finds what it created...
+                  cello::Object again { bazPath, &root };
+                  expect (again.getCreationType () == Object::CreationType::wrapped);
+                  expect (juce::ValueTree { again } == juce::ValueTree { baz });
+                  // ...as does the string it was compiled from.
+                  cello::Object fromString { "/foo/bar/baz", root };
+                  expect (juce::ValueTree { fromString } == juce::ValueTree { baz });
+
+                  cello::Object bar { cello::CompiledPath::get ("^bar"), juce::ValueTree { baz } };
+                  expect (bar.getType ().toString () == "bar");
+
+                  // a compiled type and its string make the same child.
+                  cello::Object point { cello::CompiledPath::get ("point"), &root };
+                  cello::Object pointByString { "point", root };
+                  expect (juce::ValueTree { point } == juce::ValueTree { pointByString });
+                  expectEquals (juce::ValueTree { root }.getNumChildren (), 2);
+              });
+
+#if 0
+        // re-enable this to compare creating Objects by type string and by
+        // compiled type (which skips the cache of compiled paths.)
+        test ("compiled type timing",
+              [this] ()
+              {
+                  cello::Object root ("root", nullptr);
+                  const int count { 10000 };
+                  const auto pointPath { cello::CompiledPath::get ("point") };
+                  auto timeCreation = [&] (auto&& type)
+                  {
+                      const auto startTicks { juce::Time::getHighResolutionTicks () };
+                      for (int i { 0 }; i < count; ++i)
+                          cello::Object point { type, &root };
+                      return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks () -
+                                                                       startTicks);
+                  };
+                  const auto stringTime { timeCreation (juce::String ("point")) };
+                  const auto compiledTime { timeCreation (pointPath) };
+                  DBG (count << " Objects: " << (stringTime * 1.0e9 / count) << "ns each by type string, "
+                             << (compiledTime * 1.0e9 / count) << "ns each by compiled type");
+                  juce::ignoreUnused (stringTime, compiledTime);
+              });
+#endif
+
         test ("change notify tree",
               [&] ()
               {
@@ -679,6 +867,140 @@ public:
                       expectEquals (val.getValue (), i);
                   }
               });
+        test ("shared dispatch",
+              [&] ()
+              {
+                  cello::Object root { "root", nullptr };
+                  std::vector<std::unique_ptr<CountingObject>> rootObjects;
+                  for (int i { 0 }; i < 50; ++i)
+                      rootObjects.push_back (std::make_unique<CountingObject> ("root", root));
+
+                  std::vector<std::unique_ptr<OneValue>> children;
+                  for (int i { 0 }; i < 10; ++i)
+                  {
+                      OneValue child { i };
+                      root.append (&child);
+                      children.push_back (std::make_unique<OneValue> (root[i]));
+                  }
+
+                  int childCount { 0 };
+                  children[3]->onPropertyChange (OneValue::valId, [&childCount] (juce::Identifier) { ++childCount; });
+                  children[3]->setValue (10);
+                  expectEquals (childCount, 1);
+                  // Objects wrapping the root aren't visited for changes to its children...
+                  for (const auto& obj : rootObjects)
+                      expectEquals (obj->callCount, 0);
+
+                  // ...unless they ask to be.
+                  rootObjects[0]->listenToSubtree (true);
+                  children[3]->setValue (11);
+                  expectEquals (childCount, 2);
+                  expectEquals (rootObjects[0]->callCount, 1);
+                  expectEquals (rootObjects[1]->callCount, 0);
+
+                  // changes to the root itself go to all of them.
+                  root.setattr ("name", juce::String ("bob"));
+                  for (const auto& obj : rootObjects)
+                      expectEquals (obj->callCount, obj == rootObjects[0] ? 2 : 1);
+
+                  // an Object may be destroyed from inside another Object's
+                  // callback without disturbing the others bound to that tree.
+                  OneValue killer { juce::ValueTree (*children[3]) };
+                  auto doomed { std::make_unique<OneValue> (juce::ValueTree (*children[3])) };
+                  doomed->onPropertyChange (OneValue::valId, [] (juce::Identifier) {});
+                  killer.onPropertyChange (OneValue::valId, [&doomed] (juce::Identifier) { doomed.reset (); });
+                  children[3]->setValue (12);
+                  expect (doomed == nullptr);
+                  expectEquals (childCount, 3);
+                  children[3]->setValue (13);
+                  expectEquals (childCount, 4);
+              });
+
+        test ("dispatch for many siblings",
+              [&] ()
+              {
+                  // thousands of Objects wrapping same-type trees each find (or
+                  // make) their own tree's Dispatcher in constant time.
+                  const int childCount { 5000 };
+                  cello::Object root { "root", nullptr };
+                  juce::ValueTree rootTree { root };
+                  for (int i { 0 }; i < childCount; ++i)
+                      rootTree.appendChild (juce::ValueTree { OneValue::classId }, nullptr);
+
+                  std::vector<std::unique_ptr<OneValue>> first;
+                  std::vector<std::unique_ptr<OneValue>> second;
+                  for (int i { 0 }; i < childCount; ++i)
+                  {
+                      first.push_back (std::make_unique<OneValue> (root[i]));
+                      second.push_back (std::make_unique<OneValue> (root[i]));
+                  }
+
+                  int count { 0 };
+                  const int target { childCount / 2 };
+                  for (int i { target - 1 }; i <= target + 1; ++i)
+                      second[static_cast<size_t> (i)]->onPropertyChange (OneValue::valId,
+                                                                         [&count] (juce::Identifier) { ++count; });
+                  first[static_cast<size_t> (target)]->setValue (99);
+                  // only the other Object bound to the same tree hears about it.
+                  expectEquals (count, 1);
+                  expectEquals (second[static_cast<size_t> (target)]->getValue (), 99);
+
+                  // (if JUCE's ValueTree layout changed, the identity isn't
+                  // used, and the registry falls back to comparing trees.)
+                  const auto identity { cello::getTreeIdentity (rootTree.getChild (target)) };
+                  if (identity != nullptr)
+                  {
+                      expect (identity == cello::getTreeIdentity (juce::ValueTree { *first[static_cast<size_t> (target)] }));
+                      expect (identity != cello::getTreeIdentity (rootTree.getChild (target + 1)));
+                  }
+                  expect (cello::getTreeIdentity (juce::ValueTree {}) == nullptr);
+              });
+
+#if 0
+        // re-enable this to time binding Objects to many same-type siblings.
+        test ("dispatch for many siblings timing",
+              [&] ()
+              {
+                  const int childCount { 5000 };
+                  cello::Object root { "root", nullptr };
+                  juce::ValueTree rootTree { root };
+                  for (int i { 0 }; i < childCount; ++i)
+                      rootTree.appendChild (juce::ValueTree { OneValue::classId }, nullptr);
+
+                  const auto startTicks { juce::Time::getHighResolutionTicks () };
+                  std::vector<std::unique_ptr<OneValue>> objects;
+                  for (int i { 0 }; i < 2 * childCount; ++i)
+                      objects.push_back (std::make_unique<OneValue> (root[i % childCount]));
+                  const auto elapsed { juce::Time::highResolutionTicksToSeconds (
+                      juce::Time::getHighResolutionTicks () - startTicks) };
+                  DBG (2 * childCount << " sibling Objects: " << (elapsed * 1.0e9 / (2 * childCount))
+                                      << "ns per Object");
+                  juce::ignoreUnused (elapsed);
+              });
+#endif
+
+        test ("dispatch after full sync",
+              [&] ()
+              {
+                  OneValue ov (1);
+                  int redirectCount { 0 };
+                  int changeCount { 0 };
+                  ov.onTreeRedirected = [&redirectCount] () { ++redirectCount; };
+                  ov.onPropertyChange (OneValue::valId, [&changeCount] (juce::Identifier) { ++changeCount; });
+
+                  // a full sync message replaces the tree wholesale.
+                  OneValue other (25);
+                  juce::MemoryOutputStream out;
+                  out.writeByte (2);
+                  juce::ValueTree (other).writeToStream (out);
+                  ov.update (out.getMemoryBlock ());
+                  expectEquals (redirectCount, 1);
+                  expectEquals (ov.getValue (), 25);
+
+                  // ...and we receive callbacks for the new tree.
+                  ov.setValue (26);
+                  expectEquals (changeCount, 1);
+              });
     }
 
 private:
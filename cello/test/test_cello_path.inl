@@ -209,6 +209,39 @@ public:
                   auto t4 { p2.findValueTree (nullTree, Path::SearchType::createAll) };
                   expect (!t4.isValid ());
               });
+        test ("compiled paths",
+              [this] ()
+              {
+                  // the same path string always gets the same compiled path.
+                  auto compiled { CompiledPath::get ("../ right / rightleft") };
+                  expect (compiled == CompiledPath::get ("../ right / rightleft"));
+                  expect (compiled != CompiledPath::get ("../right/rightright"));
+
+                  const auto& segments { compiled->getSegments () };
+                  expectEquals (static_cast<int> (segments.size ()), 3);
+                  expect (segments[0].kind == CompiledPath::SegmentKind::parent);
+                  expect (segments[1].kind == CompiledPath::SegmentKind::child);
+                  expect (segments[1].type == juce::Identifier ("right"));
+                  expect (segments[2].type == juce::Identifier ("rightleft"));
+
+                  auto ancestors { CompiledPath::get ("/^root/.") };
+                  expect (ancestors->getSegments ()[0].kind == CompiledPath::SegmentKind::root);
+                  expect (ancestors->getSegments ()[2].kind == CompiledPath::SegmentKind::ancestor);
+                  expect (ancestors->getSegments ()[2].type == juce::Identifier ("root"));
+                  expect (ancestors->getSegments ()[3].kind == CompiledPath::SegmentKind::current);
+
+                  // a Path made from a compiled path finds what the string would.
+                  auto left { rootTree.getChildWithName ("left") };
+                  Path fromCompiled { compiled };
+                  auto t1 { fromCompiled.findValueTree (left, Path::SearchType::query) };
+                  isExpected (t1, "rightleft");
+                  expectEquals (fromCompiled.getSearchResult (), Path::SearchResult::found);
+                  expect (t1 == Path { "../right/rightleft" }.findValueTree (left, Path::SearchType::query));
+
+                  expect (CompiledPath::get ("foo")->canCreateRoot ());
+                  expect (!CompiledPath::get ("foo/bar")->canCreateRoot ());
+                  expect (!CompiledPath::get ("..")->canCreateRoot ());
+              });
     }
 
 private:
@@ -198,6 +198,44 @@ public:
                   }
               });
 
+        test ("views",
+              [this] ()
+              {
+                  cello::Object root { "root", parentTree };
+                  cello::Query query { bottomHalf };
+                  query.addComparison (valSort);
+
+                  auto found { root.find (query) };
+                  auto view { root.view (query) };
+                  expectEquals (view.size (), found.getNumChildren ());
+                  expect (!view[view.size ()].isValid ());
+
+                  // same results, same order, but the view refers to the original
+                  // children instead of copies.
+                  for (int i { 0 }; i < view.size (); ++i)
+                  {
+                      expect (view[i].isEquivalentTo (found.getChild (i)));
+                      expect (view[i].getParent () == parentTree);
+                  }
+
+                  // changes made through the view land in the original tree...
+                  for (const auto& child : view)
+                  {
+                      Data d { child };
+                      d.val += 0.5f;
+                  }
+                  expectEquals (root.view (query).size (), 0);
+
+                  // ...but a materialized copy is detached from it.
+                  auto all { root.view (cello::Query {}) };
+                  auto copy { all.materialize () };
+                  expect (copy.hasType (cello::Query::Result));
+                  expectEquals (copy.getNumChildren (), parentTree.getNumChildren ());
+                  copy.getChild (0).setProperty ("val", -1.f, nullptr);
+                  expect (!parentTree.getChild (0).isEquivalentTo (copy.getChild (0)));
+                  expectEquals (all.clone (false).getNumChildren (), parentTree.getNumChildren ());
+              });
+
         test ("double sort",
               [this] ()
               {
@@ -239,6 +277,65 @@ public:
                   expectEquals (parentTree.getNumChildren (), originalSize);
               });
 
+        test ("indexed upsert",
+              [this] ()
+              {
+                  const int originalSize { parentTree.getNumChildren () };
+                  cello::Object root { "root", parentTree };
+                  root.setIndexKey (Data::keyId);
+                  expect (root.getIndexKey () == Data::keyId);
+
+                  // every existing child can be found by its key.
+                  for (auto child : parentTree)
+                  {
+                      Data d { child };
+                      expect (root.findByKey (d.key.get ()) == child);
+                  }
+                  expect (!root.findByKey (-1000).isValid ());
+
+                  // update in place through the index...
+                  Data first { parentTree.getChild (0) };
+                  const int firstKey { first.key };
+                  Data updated { 2.f, false };
+                  updated.key = firstKey;
+                  expect (root.upsert (&updated, Data::keyId));
+                  expectEquals (parentTree.getNumChildren (), originalSize);
+                  expectWithinAbsoluteError<float> (first.val, 2.f, 0.001f);
+
+                  // ...or insert a new child, which is added to the index.
+                  Data added { 3.f, true };
+                  expect (root.upsert (&added, Data::keyId));
+                  expectEquals (parentTree.getNumChildren (), originalSize + 1);
+                  expect (root.findByKey (added.key.get ()).isValid ());
+
+                  // changing a key re-indexes the child, and the index (not
+                  // the lookup) drops its old entry.
+                  const int newKey { Data::lastKey++ };
+                  first.key = newKey;
+                  const auto& indexed { root };
+                  expect (indexed.findByKey (newKey) == static_cast<juce::ValueTree> (first));
+                  expect (!indexed.findByKey (firstKey).isValid ());
+
+                  // if another child shares the key a child had, it takes its place.
+                  Data second { parentTree.getChild (1) };
+                  const int secondKey { second.key };
+                  Data twin { 4.f, false };
+                  twin.key = secondKey;
+                  parentTree.appendChild (juce::ValueTree { twin }, nullptr);
+                  expect (indexed.findByKey (secondKey) == static_cast<juce::ValueTree> (second));
+                  second.key = Data::lastKey++;
+                  expect (indexed.findByKey (secondKey) == static_cast<juce::ValueTree> (twin));
+                  expect (indexed.findByKey (second.key.get ()) == static_cast<juce::ValueTree> (second));
+
+                  // removing a child removes it from the index.
+                  root.remove (0);
+                  expect (!root.findByKey (newKey).isValid ());
+
+                  // clear the index.
+                  root.setIndexKey ({});
+                  expect (root.getIndexKey ().isNull ());
+              });
+
         test ("remove",
               [this] ()
               {
@@ -267,6 +364,51 @@ public:
                   expectEquals (removed, 50);
                   expectEquals (root.getNumChildren (), 0);
               });
+        test ("batched remove",
+              [this] ()
+              {
+                  juce::UndoManager undo;
+                  cello::Object root { "root", parentTree };
+                  root.setUndoManager (&undo);
+                  const auto original { parentTree.createCopy () };
+
+                  int batchCount { 0 };
+                  std::vector<int> removedIndices;
+                  root.onChildrenRemoved =
+                      [&] (const std::vector<juce::ValueTree>& children, const std::vector<int>& oldIndices)
+                  {
+                      ++batchCount;
+                      expectEquals (static_cast<int> (children.size ()), static_cast<int> (oldIndices.size ()));
+                      removedIndices = oldIndices;
+                  };
+                  int singleCount { 0 };
+                  root.onChildRemoved = [&] (juce::ValueTree&, int, int) { ++singleCount; };
+
+                  // another Object on the same tree without a batch callback
+                  // still hears about each child.
+                  cello::Object root2 { "root", parentTree };
+                  int root2Count { 0 };
+                  root2.onChildRemoved = [&] (juce::ValueTree&, int, int) { ++root2Count; };
+
+                  cello::Query odd { [] (juce::ValueTree tree) { return static_cast<bool> (Data { tree }.odd); } };
+                  undo.beginNewTransaction ();
+                  expectEquals (root.remove (odd, true), 50);
+                  expectEquals (root.getNumChildren (), 50);
+                  expectEquals (batchCount, 1);
+                  expectEquals (singleCount, 0);
+                  expectEquals (root2Count, 50);
+                  expectEquals (static_cast<int> (removedIndices.size ()), 50);
+                  expect (std::is_sorted (removedIndices.begin (), removedIndices.end ()));
+                  expectEquals (removedIndices[0], 1);
+
+                  // the whole batch comes back in one undo step.
+                  expect (root.undo ());
+                  expect (parentTree.isEquivalentTo (original));
+                  expect (root.redo ());
+                  expectEquals (root.getNumChildren (), 50);
+                  expectEquals (batchCount, 2);
+              });
+
 #if 0
         // re-enable this to explore speed of queries/sorting.
         // temp: create 100K entries so we can time speed
@@ -0,0 +1,234 @@
+/*
+    Copyright (c) 2023 Brett g Porter
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+/*
+ * Checks that `UpdateQueue::tryPerformUpdates()` doesn't allocate.
+ *
+ * To see every allocation this file replaces the global `operator new` and
+ * `operator delete`, which applies to the whole executable that it's linked
+ * into. For that reason it isn't part of the module's unity build: add it to
+ * the test runner's own sources (next to the file that includes the module),
+ * and never to an application.
+ */
+
+#include <JuceHeader.h>
+
+#if RUN_UNIT_TESTS
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+// count the heap activity on the current thread while `countingAllocations`
+// is set.
+thread_local bool countingAllocations { false };
+thread_local int allocationCount { 0 };
+} // namespace
+
+void* operator new (std::size_t size)
+{
+    if (countingAllocations)
+        ++allocationCount;
+    if (auto* ptr { std::malloc (size == 0 ? 1 : size) })
+        return ptr;
+    throw std::bad_alloc {};
+}
+
+void* operator new[] (std::size_t size)
+{
+    return operator new (size);
+}
+
+void operator delete (void* ptr) noexcept
+{
+    if (countingAllocations && ptr != nullptr)
+        ++allocationCount;
+    std::free (ptr);
+}
+
+void operator delete[] (void* ptr) noexcept
+{
+    operator delete (ptr);
+}
+
+void operator delete (void* ptr, std::size_t) noexcept
+{
+    operator delete (ptr);
+}
+
+void operator delete[] (void* ptr, std::size_t) noexcept
+{
+    operator delete (ptr);
+}
+
+namespace
+{
+/**
+ * @brief Counts the allocations on this thread for as long as it exists.
+ */
+class AllocationCounter
+{
+public:
+    AllocationCounter ()
+    {
+        allocationCount     = 0;
+        countingAllocations = true;
+    }
+
+    ~AllocationCounter () { countingAllocations = false; }
+
+    int getCount () const { return allocationCount; }
+};
+
+class RealtimeTestObject : public cello::Object
+{
+public:
+    RealtimeTestObject ()
+    : cello::Object ("rto", nullptr)
+    {
+    }
+
+    MAKE_VALUE_MEMBER (int, x, {});
+    MAKE_VALUE_MEMBER (int, y, {});
+};
+
+/**
+ * @brief Stands in for the real-time thread that owns the destination tree;
+ * the test drains its queue directly.
+ */
+class ConsumerThread : public juce::Thread
+{
+public:
+    ConsumerThread ()
+    : juce::Thread ("realtime")
+    {
+    }
+
+    void run () override
+    {
+        while (!threadShouldExit ())
+            wait (1000);
+    }
+
+    RealtimeTestObject rto;
+};
+
+/**
+ * @brief Sets a value as quickly as it can, to load up a Sync.
+ */
+class ProducerThread : public juce::Thread
+{
+public:
+    ProducerThread (int count)
+    : juce::Thread ("burst")
+    , updateCount { count }
+    {
+    }
+
+    void run () override
+    {
+        for (int i { 1 }; i <= updateCount; ++i)
+            rto.x = i;
+    }
+
+    int updateCount;
+    RealtimeTestObject rto;
+};
+
+cello::QueueOptions realtimeOptions ()
+{
+    cello::QueueOptions options;
+    options.lockFree = true;
+    options.overflow = cello::QueueOptions::Overflow::drop;
+    return options;
+}
+
+} // namespace
+
+class Test_RealtimeAllocations : public TestSuite
+{
+public:
+    Test_RealtimeAllocations ()
+    : TestSuite ("realtime_allocations", "cello")
+    {
+    }
+
+    void runTest () override
+    {
+        test ("drain without allocating",
+              [this] ()
+              {
+                  RealtimeTestObject src;
+                  ConsumerThread thread;
+                  cello::Sync sync (src, thread.rto, &thread, nullptr, realtimeOptions ());
+
+                  // the first pass through may set up listener lists, etc.
+                  src.x = 1;
+                  expectEquals (sync.tryPerformUpdates (10), 1);
+
+                  for (int i { 2 }; i <= 101; ++i)
+                      src.x = i;
+
+                  int applied { 0 };
+                  int allocations { 0 };
+                  {
+                      AllocationCounter counter;
+                      applied     = sync.tryPerformUpdates (1000);
+                      allocations = counter.getCount ();
+                  }
+                  expectEquals (applied, 100);
+                  expectEquals ((int) thread.rto.x, 101);
+                  expectEquals (allocations, 0);
+              });
+
+        test ("drain without allocating while the producer runs",
+              [this] ()
+              {
+                  const int updateCount { 100000 };
+                  ProducerThread producer { updateCount };
+                  ConsumerThread consumer;
+                  cello::Sync sync (producer.rto, consumer.rto, &consumer, nullptr, realtimeOptions ());
+                  producer.rto.y = 1;
+                  sync.tryPerformUpdates (1);
+
+                  // drain on this thread while the producer runs flat out;
+                  // only this thread's heap activity is counted.
+                  producer.startThread ();
+                  int allocations { 0 };
+                  while (producer.isThreadRunning () || sync.getPendingUpdateCount () > 0)
+                  {
+                      {
+                          AllocationCounter counter;
+                          sync.tryPerformUpdates (64, 0.5);
+                          allocations += counter.getCount ();
+                      }
+                      // (a real application would do this outside of its
+                      // real-time callback.)
+                      if (sync.isFullSyncPending ())
+                          sync.performNextUpdate ();
+                  }
+                  expectEquals (allocations, 0);
+              });
+    }
+};
+
+static Test_RealtimeAllocations testRealtimeAllocations;
+
+#endif